@@ -0,0 +1,1261 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <usb_asio/simulation.hpp>
+#include <usb_asio/usb_asio.hpp>
+
+#ifdef USB_ASIO_USE_STANDALONE_ASIO
+
+#include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+
+#else
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#endif
+
+namespace asio = usb_asio::asio;
+namespace simulation = usb_asio::simulation;
+
+using usb_asio::error_code;
+
+namespace
+{
+    std::atomic<std::uint64_t> num_allocations = 0;
+}  // namespace
+
+auto operator new(std::size_t const size) -> void*
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto const ptr = std::malloc(std::max(size, std::size_t{1})))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+auto operator new(std::size_t const size, std::align_val_t const alignment) -> void*
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    auto const align = static_cast<std::size_t>(alignment);
+    if (auto const ptr = std::aligned_alloc(align, (std::max(size, std::size_t{1}) + align - 1u) / align * align))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* const ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* const ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* const ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* const ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    constexpr auto vendor_id = std::uint16_t{0xFFFFu};
+    constexpr auto bulk_in_endpoint = std::uint8_t{0x81u};
+    constexpr auto bulk_out_endpoint = std::uint8_t{0x01u};
+    constexpr auto interrupt_in_endpoint = std::uint8_t{0x82u};
+    constexpr auto iso_in_endpoint = std::uint8_t{0x83u};
+    constexpr auto iso_packet_size = std::size_t{1024};
+    constexpr auto iso_packets_per_transfer = std::size_t{8};
+    constexpr auto blocking_request_duration = std::chrono::milliseconds{2};
+
+    struct options
+    {
+        std::size_t iterations = 20000;
+        std::size_t warmup_iterations = 1000;
+        std::chrono::nanoseconds device_latency = std::chrono::nanoseconds{0};
+        std::size_t transfer_size = 512;
+        std::size_t threads = 4;
+        std::string output;
+    };
+
+    struct result
+    {
+        std::string benchmark;
+        std::vector<std::pair<std::string, std::string>> params;
+        std::vector<std::pair<std::string, double>> metrics = {};
+    };
+
+    class report
+    {
+      public:
+        explicit report(options const& opts)
+          : options_{opts} { }
+
+        void add(result res)
+        {
+            std::cerr << res.benchmark;
+            for (auto const& [name, value] : res.params)
+            {
+                std::cerr << ' ' << name << '=' << value;
+            }
+            std::cerr << '\n';
+
+            results_.push_back(std::move(res));
+        }
+
+        [[nodiscard]] auto to_json() const -> std::string
+        {
+            auto out = fmt::memory_buffer{};
+            auto it = std::back_inserter(out);
+
+            fmt::format_to(
+                it,
+                "{{\n  \"options\": {{\"iterations\": {}, \"device_latency_ns\": {}, "
+                "\"transfer_size\": {}, \"threads\": {}}},\n  \"results\": [",
+                options_.iterations,
+                options_.device_latency.count(),
+                options_.transfer_size,
+                options_.threads);
+
+            auto first_result = true;
+            for (auto const& res : results_)
+            {
+                fmt::format_to(it, "{}\n    {{\"benchmark\": \"{}\", \"params\": {{", first_result ? "" : ",", res.benchmark);
+                first_result = false;
+
+                auto first = true;
+                for (auto const& [name, value] : res.params)
+                {
+                    fmt::format_to(it, "{}\"{}\": \"{}\"", first ? "" : ", ", name, value);
+                    first = false;
+                }
+
+                fmt::format_to(it, "}}, \"metrics\": {{");
+                first = true;
+                for (auto const& [name, value] : res.metrics)
+                {
+                    fmt::format_to(it, "{}\"{}\": {}", first ? "" : ", ", name, value);
+                    first = false;
+                }
+                fmt::format_to(it, "}}}}");
+            }
+            fmt::format_to(it, "\n  ]\n}}\n");
+
+            return fmt::to_string(out);
+        }
+
+      private:
+        options options_;
+        std::vector<result> results_;
+    };
+
+    [[nodiscard]] auto cpu_time(clockid_t const clock_id) -> std::chrono::nanoseconds
+    {
+        auto time = ::timespec{};
+        ::clock_gettime(clock_id, &time);
+        return std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec};
+    }
+
+    // CPU time of the process and of libusb event handling (on the event threads,
+    // or the io_context threads with an event reactor), and allocations, over the lifetime of the measurement.
+    class measurement
+    {
+      public:
+        measurement()
+          : start_{clock::now()}
+          , process_cpu_{cpu_time(CLOCK_PROCESS_CPUTIME_ID)}
+          , event_handling_cpu_{simulation::event_handling_cpu_time()}
+          , allocations_{num_allocations.load(std::memory_order_relaxed)} { }
+
+        void finish(result& res, std::size_t const num_ops) const
+        {
+            auto const elapsed = std::chrono::duration<double>{clock::now() - start_};
+            auto const process_cpu = cpu_time(CLOCK_PROCESS_CPUTIME_ID) - process_cpu_;
+            auto const event_handling_cpu = simulation::event_handling_cpu_time() - event_handling_cpu_;
+            auto const allocations = num_allocations.load(std::memory_order_relaxed) - allocations_;
+            auto const ops = static_cast<double>(std::max(num_ops, std::size_t{1}));
+
+            res.metrics.emplace_back("ops_per_second", ops / elapsed.count());
+            res.metrics.emplace_back("allocations_per_op", static_cast<double>(allocations) / ops);
+            res.metrics.emplace_back("cpu_ns_per_op", static_cast<double>(process_cpu.count()) / ops);
+            res.metrics.emplace_back(
+                "event_handling_cpu_ns_per_op",
+                static_cast<double>(event_handling_cpu.count()) / ops);
+        }
+
+      private:
+        clock::time_point start_;
+        std::chrono::nanoseconds process_cpu_;
+        std::chrono::nanoseconds event_handling_cpu_;
+        std::uint64_t allocations_;
+    };
+
+    void add_percentiles(result& res, std::vector<clock::duration>& samples)
+    {
+        if (samples.empty()) { return; }
+
+        std::ranges::sort(samples);
+        auto const percentile = [&](double const p) {
+            auto const index = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1u));
+            return static_cast<double>(std::chrono::nanoseconds{samples[index]}.count());
+        };
+
+        res.metrics.emplace_back("latency_p50_ns", percentile(0.5));
+        res.metrics.emplace_back("latency_p90_ns", percentile(0.9));
+        res.metrics.emplace_back("latency_p99_ns", percentile(0.99));
+        res.metrics.emplace_back("latency_p999_ns", percentile(0.999));
+        res.metrics.emplace_back("latency_max_ns", percentile(1.0));
+    }
+
+    [[nodiscard]] auto add_device(
+        options const& opts,
+        std::uint16_t const product_id,
+        bool const loopback = false) -> simulation::simulated_device_id
+    {
+        auto config = simulation::simulated_device_config{};
+        config.product_id = product_id;
+        config.endpoints = {
+            {.address = bulk_in_endpoint, .type = usb_asio::usb_transfer_type::bulk},
+            {.address = bulk_out_endpoint, .type = usb_asio::usb_transfer_type::bulk},
+            {.address = interrupt_in_endpoint, .type = usb_asio::usb_transfer_type::interrupt, .max_packet_size = 64, .interval = 1},
+            {.address = iso_in_endpoint, .type = usb_asio::usb_transfer_type::isochronous, .max_packet_size = iso_packet_size, .interval = 1},
+        };
+        config.latency = opts.device_latency;
+        config.blocking_request_duration = blocking_request_duration;
+        config.loopback = loopback;
+        return simulation::add_device(config);
+    }
+
+    [[nodiscard]] auto find_device(asio::io_context& ioc, std::uint16_t const product_id) -> usb_asio::usb_device_info
+    {
+        for (auto& info : usb_asio::list_usb_devices(ioc))
+        {
+            auto const descriptor = info.device_descriptor();
+            if (descriptor.idVendor == vendor_id && descriptor.idProduct == product_id)
+            {
+                return std::move(info);
+            }
+        }
+
+        throw std::runtime_error{"simulated device not found"};
+    }
+
+    struct event_mode
+    {
+        std::string_view name;
+        bool reactor;
+        usb_asio::usb_completion_dispatch dispatch;
+    };
+
+    constexpr auto event_modes = std::array{
+        event_mode{"thread", false, usb_asio::usb_completion_dispatch::post},
+        event_mode{"reactor", true, usb_asio::usb_completion_dispatch::post},
+        event_mode{"reactor_dispatch", true, usb_asio::usb_completion_dispatch::dispatch},
+    };
+
+    void make_usb_service(
+        asio::io_context& ioc,
+        event_mode const& mode,
+        std::size_t const event_shards = 1,
+        std::size_t const blocking_op_threads = 1)
+    {
+        asio::make_service<usb_asio::usb_service>(
+            ioc,
+            usb_asio::usb_service_options{
+                .event_reactor = mode.reactor ? &ioc : nullptr,
+                .event_shards = event_shards,
+                .blocking_op_threads = blocking_op_threads,
+            });
+    }
+
+    // Submits one transfer at a time, resubmitting it from the completion handler.
+    template <typename Transfer, typename Submit>
+    class ping_pong
+    {
+      public:
+        ping_pong(
+            asio::io_context& ioc,
+            Transfer& transfer,
+            Submit submit,
+            std::size_t const num_ops)
+          : ioc_{ioc}
+          , transfer_{transfer}
+          , submit_{std::move(submit)}
+          , remaining_{num_ops}
+        {
+            samples_.reserve(num_ops);
+        }
+
+        void start()
+        {
+            submitted_ = clock::now();
+            submit_(transfer_, [this](error_code const ec, auto&&) {
+                on_completion(ec);
+            });
+        }
+
+        [[nodiscard]] auto samples() -> std::vector<clock::duration>&
+        {
+            return samples_;
+        }
+
+        [[nodiscard]] auto errors() const noexcept -> std::size_t
+        {
+            return errors_;
+        }
+
+      private:
+        asio::io_context& ioc_;
+        Transfer& transfer_;
+        Submit submit_;
+        std::size_t remaining_;
+        std::size_t errors_ = 0;
+        clock::time_point submitted_;
+        std::vector<clock::duration> samples_;
+
+        void on_completion(error_code const ec)
+        {
+            samples_.push_back(clock::now() - submitted_);
+            if (ec) { ++errors_; }
+
+            if (--remaining_ == 0)
+            {
+                ioc_.stop();
+                return;
+            }
+
+            start();
+        }
+    };
+
+    template <typename Transfer, typename Submit>
+    void run_ping_pong(
+        report& rep,
+        options const& opts,
+        asio::io_context& ioc,
+        Transfer& transfer,
+        Submit submit,
+        result res)
+    {
+        // Warm up the handler memory, the libusb side and the caches
+        auto warmup = ping_pong{ioc, transfer, submit, opts.warmup_iterations};
+        warmup.start();
+        ioc.run();
+        ioc.restart();
+
+        auto loop = ping_pong{ioc, transfer, submit, opts.iterations};
+        auto const meas = measurement{};
+        loop.start();
+        ioc.run();
+        meas.finish(res, opts.iterations);
+        ioc.restart();
+
+        add_percentiles(res, loop.samples());
+        res.metrics.emplace_back("errors", static_cast<double>(loop.errors()));
+        rep.add(std::move(res));
+    }
+
+    // Submit-to-handler latency of each transfer type, one transfer in flight.
+    void bench_latency(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        for (auto const& mode : event_modes)
+        {
+            auto const make_result = [&](std::string_view const transfer_type) {
+                return result{
+                    .benchmark = "latency",
+                    .params = {
+                        {"transfer_type", std::string{transfer_type}},
+                        {"event_mode", std::string{mode.name}},
+                    },
+                };
+            };
+
+            auto ioc = asio::io_context{};
+            // The event thread gives up the work of a completion only after posting it,
+            // which could stop the next run of the io_context when it runs out of work
+            auto const work = asio::require(ioc.get_executor(), asio::execution::outstanding_work.tracked);
+            make_usb_service(ioc, mode);
+            auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+            auto buffer = std::vector<std::byte>(std::max(opts.transfer_size, iso_packet_size * iso_packets_per_transfer));
+            auto const data = asio::buffer(buffer.data(), opts.transfer_size);
+
+            {
+                auto transfer = usb_asio::usb_in_control_transfer{ioc.get_executor(), dev};
+                transfer.set_completion_dispatch(mode.dispatch);
+                auto control_buffer = usb_asio::usb_control_transfer_buffer{64};
+                run_ping_pong(
+                    rep,
+                    opts,
+                    ioc,
+                    transfer,
+                    [&](auto& t, auto&& handler) {
+                        t.async_control(
+                            usb_asio::usb_control_request_recipient::device,
+                            usb_asio::usb_control_request_type::vendor_request,
+                            0x01u,
+                            0,
+                            0,
+                            control_buffer,
+                            std::forward<decltype(handler)>(handler));
+                    },
+                    make_result("control"));
+            }
+
+            {
+                // Plain buffer, stored inside the transfer
+                auto transfer = usb_asio::usb_in_control_transfer{dev};
+                transfer.set_completion_dispatch(mode.dispatch);
+                auto status = std::array<std::byte, 8>{};
+                run_ping_pong(
+                    rep,
+                    opts,
+                    ioc,
+                    transfer,
+                    [&](auto& t, auto&& handler) {
+                        t.async_control(
+                            usb_asio::usb_control_request_recipient::device,
+                            usb_asio::usb_control_request_type::vendor_request,
+                            0x01u,
+                            0,
+                            0,
+                            asio::buffer(status),
+                            std::forward<decltype(handler)>(handler));
+                    },
+                    make_result("control_small"));
+            }
+
+            auto const read = [&](auto& t, auto&& handler) {
+                t.async_read_some(data, std::forward<decltype(handler)>(handler));
+            };
+
+            {
+                auto transfer = usb_asio::usb_in_bulk_transfer{dev, bulk_in_endpoint};
+                transfer.set_completion_dispatch(mode.dispatch);
+                run_ping_pong(rep, opts, ioc, transfer, read, make_result("bulk"));
+            }
+
+            {
+                auto transfer = usb_asio::usb_in_interrupt_transfer{dev, interrupt_in_endpoint};
+                transfer.set_completion_dispatch(mode.dispatch);
+                run_ping_pong(rep, opts, ioc, transfer, read, make_result("interrupt"));
+            }
+
+            {
+                auto transfer = usb_asio::usb_in_bulk_stream_transfer{dev, bulk_in_endpoint, 1u};
+                transfer.set_completion_dispatch(mode.dispatch);
+                run_ping_pong(rep, opts, ioc, transfer, read, make_result("bulk_stream"));
+            }
+
+            {
+                auto transfer = usb_asio::usb_in_isochronous_transfer{
+                    dev,
+                    iso_in_endpoint,
+                    iso_packets_per_transfer,
+                    iso_packet_size,
+                };
+                transfer.set_completion_dispatch(mode.dispatch);
+                run_ping_pong(
+                    rep,
+                    opts,
+                    ioc,
+                    transfer,
+                    [&](auto& t, auto&& handler) {
+                        t.async_read_some(
+                            asio::buffer(buffer.data(), iso_packet_size * iso_packets_per_transfer),
+                            std::forward<decltype(handler)>(handler));
+                    },
+                    make_result("isochronous"));
+            }
+
+            {
+                // A scattered write may complete before its submission returns
+                auto transfer = usb_asio::usb_out_bulk_transfer{dev, bulk_out_endpoint};
+                transfer.set_completion_dispatch(mode.dispatch);
+                auto payload = std::vector<std::byte>(16384);
+                auto const buffers = std::array{
+                    asio::const_buffer{payload.data(), 8192},
+                    asio::const_buffer{payload.data() + 8192, 8192},
+                };
+                run_ping_pong(
+                    rep,
+                    opts,
+                    ioc,
+                    transfer,
+                    [&](auto& t, auto&& handler) {
+                        t.async_write_some(
+                            buffers,
+                            usb_asio::with_deadline(std::chrono::seconds{1}, std::forward<decltype(handler)>(handler)));
+                    },
+                    make_result("bulk_out_scattered_deadline"));
+            }
+        }
+    }
+
+    struct coroutine_loop
+    {
+        asio::io_context& ioc;
+        std::size_t num_ops;
+        std::vector<clock::duration> samples = {};
+        std::size_t errors = 0;
+    };
+
+    // The minimal coroutine type awaiting usb_asio::use_awaiter
+    struct detached_task
+    {
+        struct promise_type
+        {
+            auto get_return_object() noexcept -> detached_task { return {}; }
+            auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+            auto final_suspend() noexcept -> std::suspend_never { return {}; }
+            void return_void() noexcept { }
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    auto read_with_use_awaitable(
+        usb_asio::usb_in_bulk_transfer& transfer,
+        asio::mutable_buffer const data,
+        coroutine_loop& loop) -> asio::awaitable<void>
+    {
+        for (auto index = std::size_t{0}; index < loop.num_ops; ++index)
+        {
+            auto const submitted = clock::now();
+            auto ec = error_code{};
+            co_await transfer.async_read_some(data, asio::redirect_error(asio::use_awaitable, ec));
+            loop.samples.push_back(clock::now() - submitted);
+            if (ec) { ++loop.errors; }
+        }
+        loop.ioc.stop();
+    }
+
+    auto read_with_use_awaiter(
+        usb_asio::usb_in_bulk_transfer& transfer,
+        asio::mutable_buffer const data,
+        coroutine_loop& loop) -> detached_task
+    {
+        for (auto index = std::size_t{0}; index < loop.num_ops; ++index)
+        {
+            auto const submitted = clock::now();
+            auto ec = error_code{};
+            co_await transfer.async_read_some(data, usb_asio::use_awaiter(ec));
+            loop.samples.push_back(clock::now() - submitted);
+            if (ec) { ++loop.errors; }
+        }
+        loop.ioc.stop();
+    }
+
+    // Bulk read latency of a coroutine awaiting through the generic completion token path
+    // (asio::use_awaitable), versus the transfer's own awaiter (usb_asio::use_awaiter).
+    void bench_coroutines(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        for (auto const& mode : event_modes)
+        {
+            auto ioc = asio::io_context{};
+            auto const work = asio::require(ioc.get_executor(), asio::execution::outstanding_work.tracked);
+            make_usb_service(ioc, mode);
+            auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+            auto buffer = std::vector<std::byte>(opts.transfer_size);
+            auto const data = asio::buffer(buffer);
+            auto transfer = usb_asio::usb_in_bulk_transfer{dev, bulk_in_endpoint};
+            transfer.set_completion_dispatch(mode.dispatch);
+
+            auto const run = [&](std::string_view const path, auto const spawn) {
+                auto warmup = coroutine_loop{ioc, opts.warmup_iterations};
+                spawn(warmup);
+                ioc.run();
+                ioc.restart();
+
+                auto res = result{
+                    .benchmark = "coroutine",
+                    .params = {
+                        {"path", std::string{path}},
+                        {"event_mode", std::string{mode.name}},
+                    },
+                };
+                auto loop = coroutine_loop{ioc, opts.iterations};
+                loop.samples.reserve(opts.iterations);
+                auto const meas = measurement{};
+                spawn(loop);
+                ioc.run();
+                meas.finish(res, opts.iterations);
+                ioc.restart();
+
+                add_percentiles(res, loop.samples);
+                res.metrics.emplace_back("errors", static_cast<double>(loop.errors));
+                rep.add(std::move(res));
+            };
+
+            run("use_awaitable", [&](coroutine_loop& loop) {
+                asio::co_spawn(ioc, read_with_use_awaitable(transfer, data, loop), asio::detached);
+            });
+            run("use_awaiter", [&](coroutine_loop& loop) {
+                read_with_use_awaiter(transfer, data, loop);
+            });
+        }
+    }
+
+    // Counts the allocations of 100k bulk reads, submitted one at a time from the completion
+    // of the previous one, with a completion handler and with usb_asio::use_awaiter.
+    // Returns false (failing the benchmark run) if any of them allocates.
+    [[nodiscard]] auto check_allocations(report& rep, options const& opts, std::uint16_t const product_id) -> bool
+    {
+        constexpr auto num_submits = std::size_t{100000};
+
+        auto passed = true;
+        for (auto const& mode : event_modes)
+        {
+            auto ioc = asio::io_context{};
+            auto const work = asio::require(ioc.get_executor(), asio::execution::outstanding_work.tracked);
+            make_usb_service(ioc, mode);
+            auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+            auto buffer = std::vector<std::byte>(opts.transfer_size);
+            auto const data = asio::buffer(buffer);
+            auto transfer = usb_asio::usb_in_bulk_transfer{dev, bulk_in_endpoint};
+            transfer.set_completion_dispatch(mode.dispatch);
+
+            // start() submits the first read; the allocations of the harness
+            // (e.g. the coroutine frame) happen before the count.
+            auto const check = [&](std::string_view const path, auto const start) {
+                start(std::max(opts.warmup_iterations, std::size_t{1}));
+                ioc.run();
+                ioc.restart();
+
+                start(num_submits);
+                auto const before = num_allocations.load(std::memory_order_relaxed);
+                ioc.run();
+                auto const allocations = num_allocations.load(std::memory_order_relaxed) - before;
+                ioc.restart();
+
+                if (allocations != 0)
+                {
+                    std::cerr << "allocation check failed: " << allocations << " allocations in "
+                              << num_submits << " submits (" << path << ", " << mode.name << ")\n";
+                    passed = false;
+                }
+                rep.add(result{
+                    .benchmark = "allocation_check",
+                    .params = {
+                        {"path", std::string{path}},
+                        {"event_mode", std::string{mode.name}},
+                    },
+                    .metrics = {
+                        {"submits", static_cast<double>(num_submits)},
+                        {"allocations", static_cast<double>(allocations)},
+                    },
+                });
+            };
+
+            auto const read = [&](auto& t, auto&& handler) {
+                t.async_read_some(data, std::forward<decltype(handler)>(handler));
+            };
+            auto handler_loop = std::optional<ping_pong<usb_asio::usb_in_bulk_transfer, decltype(read)>>{};
+            check("handler", [&](std::size_t const num_ops) {
+                handler_loop.emplace(ioc, transfer, read, num_ops);
+                handler_loop->start();
+            });
+
+            auto awaiter_loop = std::optional<coroutine_loop>{};
+            check("use_awaiter", [&](std::size_t const num_ops) {
+                awaiter_loop.emplace(coroutine_loop{ioc, num_ops});
+                awaiter_loop->samples.reserve(num_ops);
+                read_with_use_awaiter(transfer, data, *awaiter_loop);
+            });
+        }
+        return passed;
+    }
+
+    // Keeps queue_depth bulk transfers in flight on each device,
+    // resubmitting each one from its completion handler.
+    class bulk_pump
+    {
+      public:
+        bulk_pump(usb_asio::usb_device& dev, std::size_t const queue_depth, std::size_t const transfer_size)
+          : buffer_(queue_depth * transfer_size)
+          , transfer_size_{transfer_size}
+        {
+            transfers_.reserve(queue_depth);
+            for (auto index = std::size_t{0}; index < queue_depth; ++index)
+            {
+                transfers_.emplace_back(dev, bulk_in_endpoint);
+            }
+        }
+
+        void start(std::atomic<std::int64_t>& remaining, asio::io_context& ioc)
+        {
+            for (auto index = std::size_t{0}; index < transfers_.size(); ++index)
+            {
+                submit(index, remaining, ioc);
+            }
+        }
+
+      private:
+        std::vector<usb_asio::usb_in_bulk_transfer> transfers_;
+        std::vector<std::byte> buffer_;
+        std::size_t transfer_size_;
+
+        void submit(std::size_t const index, std::atomic<std::int64_t>& remaining, asio::io_context& ioc)
+        {
+            transfers_[index].async_read_some(
+                asio::buffer(buffer_.data() + index * transfer_size_, transfer_size_),
+                [this, index, &remaining, &ioc](error_code const, std::size_t) {
+                    auto const left = remaining.fetch_sub(1, std::memory_order_relaxed);
+                    if (left == 1) { ioc.stop(); }
+                    if (left <= 1) { return; }
+
+                    submit(index, remaining, ioc);
+                });
+        }
+    };
+
+    void run_pumps(
+        report& rep,
+        asio::io_context& ioc,
+        std::vector<std::unique_ptr<bulk_pump>>& pumps,
+        std::size_t const num_ops,
+        std::size_t const num_threads,
+        result res)
+    {
+        auto remaining = std::atomic<std::int64_t>{static_cast<std::int64_t>(num_ops)};
+        auto const meas = measurement{};
+        for (auto& pump : pumps)
+        {
+            pump->start(remaining, ioc);
+        }
+
+        auto threads = std::vector<std::jthread>{};
+        for (auto index = std::size_t{1}; index < num_threads; ++index)
+        {
+            threads.emplace_back([&ioc]() { ioc.run(); });
+        }
+        ioc.run();
+        threads.clear();
+        meas.finish(res, num_ops);
+
+        // The transfers still in flight complete after the stop
+        ioc.restart();
+        ioc.run_for(std::chrono::milliseconds{100});
+
+        rep.add(std::move(res));
+    }
+
+    // Completions per second versus the number of bulk transfers in flight.
+    void bench_queue_depth(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        for (auto const& mode : event_modes)
+        {
+            for (auto const queue_depth : {1u, 2u, 4u, 8u, 16u, 32u, 64u})
+            {
+                auto ioc = asio::io_context{};
+                make_usb_service(ioc, mode);
+                auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+
+                auto pumps = std::vector<std::unique_ptr<bulk_pump>>{};
+                pumps.push_back(std::make_unique<bulk_pump>(dev, queue_depth, opts.transfer_size));
+
+                run_pumps(
+                    rep,
+                    ioc,
+                    pumps,
+                    opts.iterations * 5u,
+                    1,
+                    result{
+                        .benchmark = "queue_depth",
+                        .params = {
+                            {"transfer_type", "bulk"},
+                            {"event_mode", std::string{mode.name}},
+                            {"queue_depth", std::to_string(queue_depth)},
+                        },
+                    });
+            }
+        }
+    }
+
+    // Requests of the pipeline benchmark start with their correlation id and size,
+    // and are echoed back by the loopback device as their response.
+    [[nodiscard]] auto echo_framing(std::span<std::byte const> const data) -> std::optional<usb_asio::usb_response_frame>
+    {
+        auto header = std::array<std::uint32_t, 2>{};
+        if (data.size() < sizeof(header)) { return std::nullopt; }
+
+        std::memcpy(header.data(), data.data(), sizeof(header));
+        if (data.size() < header[1]) { return std::nullopt; }
+
+        return usb_asio::usb_response_frame{header[0], header[1]};
+    }
+
+    // Keeps window requests outstanding on a usb_request_pipeline, making the next one from each completion.
+    class request_client
+    {
+      public:
+        request_client(
+            asio::io_context& ioc,
+            usb_asio::usb_request_pipeline& pipeline,
+            std::size_t const window,
+            std::size_t const request_size,
+            std::size_t const num_ops)
+          : ioc_{ioc}
+          , pipeline_{pipeline}
+          , request_size_{std::max(request_size, sizeof(std::uint32_t) * 2u)}
+          , num_ops_{num_ops}
+          , requests_(window * request_size_)
+          , responses_(window * request_size_)
+        {
+        }
+
+        void start()
+        {
+            for (auto slot = std::size_t{0}; slot < requests_.size() / request_size_; ++slot)
+            {
+                submit(slot);
+            }
+        }
+
+        [[nodiscard]] auto errors() const noexcept -> std::size_t
+        {
+            return errors_;
+        }
+
+      private:
+        asio::io_context& ioc_;
+        usb_asio::usb_request_pipeline& pipeline_;
+        std::size_t request_size_;
+        std::size_t num_ops_;
+        std::vector<std::byte> requests_;
+        std::vector<std::byte> responses_;
+        std::size_t submitted_ = 0;
+        std::size_t completed_ = 0;
+        std::size_t errors_ = 0;
+
+        void submit(std::size_t const slot)
+        {
+            if (submitted_ == num_ops_) { return; }
+
+            auto const request = requests_.data() + slot * request_size_;
+            auto const header = std::array{
+                static_cast<std::uint32_t>(submitted_++),
+                static_cast<std::uint32_t>(request_size_),
+            };
+            std::memcpy(request, header.data(), sizeof(header));
+
+            pipeline_.async_request(
+                header[0],
+                asio::buffer(request, request_size_),
+                asio::buffer(responses_.data() + slot * request_size_, request_size_),
+                [this, slot](error_code const ec, std::size_t) {
+                    if (ec) { ++errors_; }
+                    if (++completed_ == num_ops_)
+                    {
+                        ioc_.stop();
+                        return;
+                    }
+
+                    submit(slot);
+                });
+        }
+    };
+
+    // Requests per second of a usb_request_pipeline versus its window,
+    // where a window of 1 is strict ping-pong.
+    void bench_request_pipeline(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        for (auto const& mode : event_modes)
+        {
+            for (auto const window : {1u, 4u, 16u, 64u})
+            {
+                auto ioc = asio::io_context{};
+                make_usb_service(ioc, mode);
+                auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+                auto res = result{
+                    .benchmark = "request_pipeline",
+                    .params = {
+                        {"event_mode", std::string{mode.name}},
+                        {"window", std::to_string(window)},
+                    },
+                };
+
+                {
+                    auto pipeline = usb_asio::usb_request_pipeline{
+                        dev,
+                        bulk_out_endpoint,
+                        bulk_in_endpoint,
+                        &echo_framing,
+                        usb_asio::usb_request_pipeline_options{
+                            .window = window,
+                            .read_size = std::max(opts.transfer_size, std::size_t{4096}),
+                            .completion_dispatch = mode.dispatch,
+                        },
+                    };
+                    auto client = request_client{ioc, pipeline, window, opts.transfer_size, opts.iterations};
+
+                    auto const meas = measurement{};
+                    client.start();
+                    ioc.run();
+                    meas.finish(res, opts.iterations);
+                    res.metrics.emplace_back("errors", static_cast<double>(client.errors()));
+                }
+
+                // Let the cancelled reads of the pipeline complete
+                ioc.restart();
+                ioc.run_for(std::chrono::milliseconds{100});
+
+                rep.add(std::move(res));
+            }
+        }
+    }
+
+    // Completions per second of many busy devices, with the devices spread over event shards.
+    void bench_event_shards(report& rep, options const& opts, std::span<std::uint16_t const> const product_ids)
+    {
+        constexpr auto queue_depth = std::size_t{8};
+
+        for (auto const event_shards : {1u, 2u, 4u})
+        {
+            auto ioc = asio::io_context{};
+            make_usb_service(ioc, event_modes[0], event_shards);
+
+            auto devices = std::vector<std::unique_ptr<usb_asio::usb_device>>{};
+            auto pumps = std::vector<std::unique_ptr<bulk_pump>>{};
+            for (auto const product_id : product_ids)
+            {
+                auto& dev = *devices.emplace_back(
+                    std::make_unique<usb_asio::usb_device>(ioc, find_device(ioc, product_id)));
+                pumps.push_back(std::make_unique<bulk_pump>(dev, queue_depth, opts.transfer_size));
+            }
+
+            run_pumps(
+                rep,
+                ioc,
+                pumps,
+                opts.iterations * 10u,
+                opts.threads,
+                result{
+                    .benchmark = "event_shards",
+                    .params = {
+                        {"devices", std::to_string(product_ids.size())},
+                        {"event_shards", std::to_string(event_shards)},
+                        {"queue_depth", std::to_string(queue_depth)},
+                    },
+                });
+
+            pumps.clear();
+        }
+    }
+
+    // Time to set the configuration, clear a halt and reset every device of a fleet,
+    // with the blocking operations run by a growing number of threads.
+    void bench_reconfiguration(report& rep, std::span<std::uint16_t const> const product_ids)
+    {
+        constexpr auto num_rounds = std::size_t{10};
+        constexpr auto ops_per_device = std::size_t{3};
+
+        for (auto const blocking_op_threads : {1u, 4u, 12u})
+        {
+            auto ioc = asio::io_context{};
+            auto const work = asio::require(ioc.get_executor(), asio::execution::outstanding_work.tracked);
+            make_usb_service(ioc, event_modes[0], 1, blocking_op_threads);
+
+            auto devices = std::vector<std::unique_ptr<usb_asio::usb_device>>{};
+            for (auto const product_id : product_ids)
+            {
+                devices.push_back(std::make_unique<usb_asio::usb_device>(ioc, find_device(ioc, product_id)));
+            }
+
+            auto res = result{
+                .benchmark = "reconfiguration",
+                .params = {
+                    {"devices", std::to_string(product_ids.size())},
+                    {"blocking_op_threads", std::to_string(blocking_op_threads)},
+                },
+            };
+
+            auto errors = std::size_t{0};
+            auto const start = clock::now();
+            auto const meas = measurement{};
+            for (auto round = std::size_t{0}; round < num_rounds; ++round)
+            {
+                auto remaining = devices.size() * ops_per_device;
+                auto on_complete = [&](auto const ec) {
+                    if (ec) { ++errors; }
+                    if (--remaining == 0) { ioc.stop(); }
+                };
+
+                // Operations on the same device run in the order they are submitted
+                for (auto& dev : devices)
+                {
+                    dev->async_set_configuration(1, on_complete);
+                    dev->async_clear_halt(bulk_in_endpoint, on_complete);
+                    dev->async_reset_device(on_complete);
+                }
+
+                ioc.restart();
+                ioc.run();
+            }
+            meas.finish(res, num_rounds * devices.size() * ops_per_device);
+
+            auto const elapsed = std::chrono::duration<double, std::milli>{clock::now() - start};
+            res.metrics.emplace_back("fleet_ms", elapsed.count() / static_cast<double>(num_rounds));
+            res.metrics.emplace_back("errors", static_cast<double>(errors));
+            rep.add(std::move(res));
+        }
+    }
+
+    // Allocate/deallocate throughput of the DMA memory resources, with a working set of buffers.
+    void bench_dma_resources(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        auto ioc = asio::io_context{};
+        auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+
+        constexpr auto working_set = std::size_t{64};
+        auto const run = [&](std::string_view const name, std::pmr::memory_resource& resource, std::size_t const size) {
+            auto blocks = std::array<void*, working_set>{};
+            for (auto& block : blocks)
+            {
+                block = resource.allocate(size);
+            }
+
+            auto const num_ops = opts.iterations * 10u;
+            auto res = result{
+                .benchmark = "dma_resource",
+                .params = {
+                    {"resource", std::string{name}},
+                    {"size", std::to_string(size)},
+                },
+            };
+            auto const meas = measurement{};
+            for (auto op = std::size_t{0}; op < num_ops; ++op)
+            {
+                auto& block = blocks[(op * 7u) % working_set];
+                resource.deallocate(block, size);
+                block = resource.allocate(size);
+            }
+            meas.finish(res, num_ops);
+
+            for (auto const block : blocks)
+            {
+                resource.deallocate(block, size);
+            }
+            rep.add(std::move(res));
+        };
+
+        for (auto const size : {512u, 4096u, 65536u})
+        {
+            {
+                auto resource = usb_asio::usb_dma_resource{dev};
+                run("usb_dma_resource", resource, size);
+            }
+            {
+                auto resource = usb_asio::usb_dma_pool_resource{dev};
+                run("usb_dma_pool_resource", resource, size);
+            }
+            {
+                auto resource = usb_asio::usb_dma_synchronized_pool_resource{dev};
+                run("usb_dma_synchronized_pool_resource", resource, size);
+            }
+            run("new_delete_resource", *std::pmr::new_delete_resource(), size);
+        }
+    }
+
+    // Stress of usb_dma_synchronized_pool_resource: blocks allocated on one thread
+    // are freed on another, the contents are checked for corruption.
+    void bench_dma_synchronized_stress(report& rep, options const& opts, std::uint16_t const product_id)
+    {
+        auto ioc = asio::io_context{};
+        auto dev = usb_asio::usb_device{ioc, find_device(ioc, product_id)};
+
+        struct block_header
+        {
+            std::size_t size;
+            std::uint64_t pattern;
+        };
+
+        for (auto const num_threads : {1u, 2u, 4u, 8u})
+        {
+            auto resource = usb_asio::usb_dma_synchronized_pool_resource{dev};
+            auto mailbox = std::array<std::atomic<block_header*>, 64>{};
+            auto errors = std::atomic<std::size_t>{0};
+            auto const ops_per_thread = opts.iterations * 10u;
+
+            auto const free_block = [&](block_header* const block) {
+                auto const words = std::span{reinterpret_cast<std::uint64_t const*>(block + 1), (block->size - sizeof(block_header)) / 8u};
+                if (std::ranges::any_of(words, [&](auto const word) { return word != block->pattern; }))
+                {
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                resource.deallocate(block, block->size);
+            };
+
+            auto res = result{
+                .benchmark = "dma_synchronized_stress",
+                .params = {{"threads", std::to_string(num_threads)}},
+            };
+            auto const meas = measurement{};
+            {
+                auto threads = std::vector<std::jthread>{};
+                for (auto thread_index = 0u; thread_index < num_threads; ++thread_index)
+                {
+                    threads.emplace_back([&, thread_index]() {
+                        auto rng = std::mt19937_64{thread_index + 1u};
+                        for (auto op = std::size_t{0}; op < ops_per_thread; ++op)
+                        {
+                            auto const size = std::size_t{64} << (rng() % 8u);
+                            auto const block = static_cast<block_header*>(resource.allocate(size));
+                            block->size = size;
+                            block->pattern = rng();
+                            std::ranges::fill(
+                                std::span{reinterpret_cast<std::uint64_t*>(block + 1), (size - sizeof(block_header)) / 8u},
+                                block->pattern);
+
+                            auto& slot = mailbox[rng() % mailbox.size()];
+                            if (auto const other = slot.exchange(block, std::memory_order_acq_rel))
+                            {
+                                free_block(other);
+                            }
+                        }
+                    });
+                }
+            }
+            meas.finish(res, ops_per_thread * num_threads);
+
+            for (auto& slot : mailbox)
+            {
+                if (auto const block = slot.exchange(nullptr))
+                {
+                    free_block(block);
+                }
+            }
+
+            res.metrics.emplace_back("errors", static_cast<double>(errors.load()));
+            rep.add(std::move(res));
+        }
+    }
+
+    [[nodiscard]] auto parse_options(int const argc, char** const argv) -> options
+    {
+        auto opts = options{};
+        auto const args = std::span{argv, static_cast<std::size_t>(argc)}.subspan(1);
+
+        for (auto arg = args.begin(); arg != args.end(); ++arg)
+        {
+            auto const name = std::string_view{*arg};
+            auto const value = [&]() -> std::string_view {
+                if (std::next(arg) == args.end())
+                {
+                    throw std::invalid_argument{fmt::format("missing value of {}", name)};
+                }
+                return *++arg;
+            };
+            auto const number = [&]() {
+                return static_cast<std::size_t>(std::stoull(std::string{value()}));
+            };
+
+            if (name == "--iterations") { opts.iterations = std::max(number(), std::size_t{1}); }
+            else if (name == "--warmup-iterations") { opts.warmup_iterations = std::max(number(), std::size_t{1}); }
+            else if (name == "--device-latency-ns") { opts.device_latency = std::chrono::nanoseconds{number()}; }
+            else if (name == "--transfer-size") { opts.transfer_size = std::max(number(), std::size_t{1}); }
+            else if (name == "--threads") { opts.threads = std::max(number(), std::size_t{1}); }
+            else if (name == "--output") { opts.output = value(); }
+            else
+            {
+                throw std::invalid_argument{fmt::format("unknown option {}", name)};
+            }
+        }
+
+        return opts;
+    }
+}  // namespace
+
+// Runs usb_asio against simulated devices, and writes the results as JSON
+// (to stdout, or to the file given with --output).
+auto main(int const argc, char** const argv) -> int
+{
+    try
+    {
+        auto const opts = parse_options(argc, argv);
+        auto rep = report{opts};
+
+        auto product_ids = std::vector<std::uint16_t>{};
+        for (auto index = 0u; index < 12u; ++index)
+        {
+            product_ids.push_back(static_cast<std::uint16_t>(0x0100u + index));
+            static_cast<void>(add_device(opts, product_ids.back()));
+        }
+        auto const loopback_product_id = std::uint16_t{0x0200u};
+        static_cast<void>(add_device(opts, loopback_product_id, true));
+
+        bench_latency(rep, opts, product_ids.front());
+        bench_coroutines(rep, opts, product_ids.front());
+        bench_queue_depth(rep, opts, product_ids.front());
+        bench_request_pipeline(rep, opts, loopback_product_id);
+        bench_event_shards(rep, opts, product_ids);
+        bench_reconfiguration(rep, product_ids);
+        bench_dma_resources(rep, opts, product_ids.front());
+        bench_dma_synchronized_stress(rep, opts, product_ids.front());
+        auto const allocations_passed = check_allocations(rep, opts, product_ids.front());
+
+        simulation::reset();
+
+        auto const json = rep.to_json();
+        if (opts.output.empty())
+        {
+            std::cout << json;
+        }
+        else
+        {
+            auto file = std::ofstream{opts.output};
+            file << json;
+        }
+
+        if (!allocations_passed)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -11,11 +11,17 @@ class UsbAsio(ConanFile):
     )
     options = {
         "asio": ["boost", "standalone"],
+        "statistics": [True, False],
         "examples": [True, False],
+        "simulation": [True, False],
+        "benchmarks": [True, False],
     }
     default_options = {
         "asio": "boost",
+        "statistics": False,
         "examples": False,
+        "simulation": False,
+        "benchmarks": False,
     }
     requires = (
         "libusb/1.0.23",
@@ -27,18 +33,26 @@ class UsbAsio(ConanFile):
 
     def requirements(self):
         if self.options.asio == "boost":
-            self.requires("boost/1.74.0")
+            self.requires("boost/1.77.0")
         else:
-            self.requires("asio/1.17.0")
+            self.requires("asio/1.19.2")
 
-        if self.options.examples:
+        if self.options.examples or self.options.benchmarks:
             self.requires("fmt/7.0.1")
 
     def build(self):
-        if self.options.examples:
+        if self.options.examples or self.options.simulation or self.options.benchmarks:
             cmake = CMake(self)
             cmake.definitions["USB_ASIO_USE_STANDALONE_ASIO"] \
                 = self.options.asio == "standalone"
+            cmake.definitions["USB_ASIO_ENABLE_STATISTICS"] \
+                = self.options.statistics
+            cmake.definitions["USB_ASIO_BUILD_EXAMPLES"] \
+                = self.options.examples
+            cmake.definitions["USB_ASIO_BUILD_SIMULATION"] \
+                = self.options.simulation
+            cmake.definitions["USB_ASIO_BUILD_BENCHMARKS"] \
+                = self.options.benchmarks
             cmake.configure()
             cmake.build()
 
@@ -47,9 +61,13 @@ class UsbAsio(ConanFile):
 
     def package_id(self):
         del self.info.options.examples
+        del self.info.options.simulation
+        del self.info.options.benchmarks
 
         self.info.header_only()
 
     def package_info(self):
         if self.options.asio == "standalone":
-            self.cpp_info.defines = ["USB_ASIO_USE_STANDALONE_ASIO"]
+            self.cpp_info.defines.append("USB_ASIO_USE_STANDALONE_ASIO")
+        if self.options.statistics:
+            self.cpp_info.defines.append("USB_ASIO_ENABLE_STATISTICS")
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <concepts>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/handler_memory.hpp"
+
+namespace usb_asio
+{
+    enum class usb_completion_dispatch
+    {
+        // The handler is always posted to its executor.
+        post,
+        // The handler is invoked directly from the completion callback,
+        // if that already runs on the handler's executor
+        // (e.g. with usb_service_options::event_reactor). Posted otherwise.
+        // The handler then runs inside libusb event handling,
+        // so it must not block or use the synchronous libusb API.
+        dispatch,
+    };
+}  // namespace usb_asio
+
+namespace usb_asio::detail
+{
+    // Keeps the executor of a completion busy until the completion is handed over to it.
+    // An any_io_executor of an io_context is unwrapped, so that asio allocates the posted
+    // function with the handler's allocator, instead of type-erasing it on the heap.
+    template <typename Executor>
+    class tracked_completion_executor
+    {
+      public:
+        explicit tracked_completion_executor(Executor const& executor)
+        {
+            if constexpr (std::same_as<Executor, asio::any_io_executor>)
+            {
+                if (auto const target = executor.template target<asio::io_context::executor_type>())
+                {
+                    io_executor_.emplace(asio::prefer(*target, asio::execution::outstanding_work.tracked));
+                    return;
+                }
+            }
+            executor_.emplace(asio::prefer(executor, asio::execution::outstanding_work.tracked));
+        }
+
+        template <typename Handler>
+        void complete(usb_completion_dispatch const dispatch, Handler&& handler) const
+        {
+            if (io_executor_.has_value())
+            {
+                hand_over(*io_executor_, dispatch, std::forward<Handler>(handler));
+            }
+            else
+            {
+                hand_over(*executor_, dispatch, std::forward<Handler>(handler));
+            }
+        }
+
+      private:
+        using tracked_executor_type = std::decay_t<decltype(asio::prefer(
+            std::declval<Executor const&>(),
+            asio::execution::outstanding_work.tracked))>;
+        using tracked_io_executor_type = std::decay_t<decltype(asio::prefer(
+            std::declval<asio::io_context::executor_type const&>(),
+            asio::execution::outstanding_work.tracked))>;
+
+        std::optional<tracked_executor_type> executor_ = std::nullopt;
+        std::optional<tracked_io_executor_type> io_executor_ = std::nullopt;
+
+        template <typename TargetExecutor, typename Handler>
+        static void hand_over(
+            TargetExecutor const& executor,
+            usb_completion_dispatch const dispatch,
+            Handler&& handler)
+        {
+            if (dispatch == usb_completion_dispatch::dispatch)
+            {
+                asio::dispatch(executor, std::forward<Handler>(handler));
+            }
+            else
+            {
+                asio::post(executor, std::forward<Handler>(handler));
+            }
+        }
+    };
+
+    // Type-erased completion handler of the single outstanding operation of an I/O object.
+    template <typename Executor, typename... Args>
+    class completion_handler
+    {
+      public:
+        completion_handler() = default;
+
+        completion_handler(completion_handler const&) = delete;
+
+        completion_handler(completion_handler&&) = delete;
+
+        ~completion_handler() noexcept
+        {
+            reset();
+        }
+
+        template <std::invocable<Args...> T>
+        void emplace(Executor const& executor, T&& handler)
+        {
+            reset();
+
+            auto const trackedEx = asio::prefer(executor, asio::execution::outstanding_work.tracked);
+            auto const trackedCompletionEx = tracked_completion_executor{
+                asio::get_associated_executor(handler, executor)};
+            // Handlers without an associated allocator get the recycled memory
+            // of this object, so that starting the next operation does not allocate.
+            auto const alloc = asio::get_associated_allocator(
+                handler,
+                handler_allocator<void>{memory_});
+
+            using impl_type = handler_impl<
+                std::decay_t<T>,
+                std::decay_t<decltype(trackedEx)>,
+                std::decay_t<decltype(trackedCompletionEx)>,
+                std::decay_t<decltype(alloc)>>;
+            using impl_alloc_traits = typename std::allocator_traits<
+                std::decay_t<decltype(alloc)>>::template rebind_traits<impl_type>;
+
+            auto impl_alloc = typename impl_alloc_traits::allocator_type{alloc};
+            auto const ptr = impl_alloc_traits::allocate(impl_alloc, 1);
+            try
+            {
+                impl_ = ::new (static_cast<void*>(std::to_address(ptr))) impl_type{
+                    trackedEx,
+                    trackedCompletionEx,
+                    std::forward<T>(handler),
+                    alloc,
+                };
+            }
+            catch (...)
+            {
+                impl_alloc_traits::deallocate(impl_alloc, ptr, 1);
+                throw;
+            }
+        }
+
+        void operator()(Args... args)
+        {
+            (*this)(usb_completion_dispatch::post, std::move(args)...);
+        }
+
+        void operator()(usb_completion_dispatch const dispatch, Args... args)
+        {
+            std::exchange(impl_, nullptr)->complete(dispatch, std::move(args)...);
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return impl_ != nullptr;
+        }
+
+        // The recycled memory, for completions handed over without a handler of this object
+        [[nodiscard]] auto get_allocator() const noexcept -> handler_allocator<void>
+        {
+            return handler_allocator<void>{memory_};
+        }
+
+        void reset() noexcept
+        {
+            if (impl_ != nullptr)
+            {
+                std::exchange(impl_, nullptr)->destroy();
+            }
+        }
+
+        auto operator=(completion_handler const&) = delete;
+
+        auto operator=(completion_handler&&) = delete;
+
+      private:
+        struct erased_handler
+        {
+            // Hands the handler over to its executor, freeing this object before the upcall.
+            virtual void complete(usb_completion_dispatch dispatch, Args&&... args) = 0;
+
+            virtual void destroy() noexcept = 0;
+
+          protected:
+            ~erased_handler() noexcept = default;
+        };
+
+        template <typename T,
+                  typename TrackedExecutor,
+                  typename TrackedCompletionExecutor,
+                  typename Alloc>
+        struct handler_impl final : erased_handler
+        {
+            TrackedExecutor executor;
+            TrackedCompletionExecutor completion_executor;
+            T handler;
+            Alloc alloc;
+
+            template <typename OtherT>
+            handler_impl(
+                TrackedExecutor const& executor,
+                TrackedCompletionExecutor const& completion_executor,
+                OtherT&& handler,
+                Alloc const& alloc)
+              : executor{executor}
+              , completion_executor{completion_executor}
+              , handler{std::forward<OtherT>(handler)}
+              , alloc{alloc} { }
+
+            void complete(usb_completion_dispatch const dispatch, Args&&... args) override
+            {
+                // Keep the work guard until the handler is posted
+                auto const work_executor = std::move(executor);
+                auto const target_executor = std::move(completion_executor);
+                auto bound_handler = detail::bind_handler(alloc, std::move(handler), std::move(args)...);
+                destroy();
+
+                target_executor.complete(dispatch, std::move(bound_handler));
+            }
+
+            void destroy() noexcept override
+            {
+                using alloc_traits = typename std::allocator_traits<Alloc>::template rebind_traits<handler_impl>;
+
+                auto impl_alloc = typename alloc_traits::allocator_type{alloc};
+                this->~handler_impl();
+                alloc_traits::deallocate(impl_alloc, this, 1);
+            }
+        };
+
+        erased_handler* impl_ = nullptr;
+        std::shared_ptr<handler_memory> memory_ = std::make_shared<handler_memory>();
+    };
+
+}  // namespace usb_asio::detail
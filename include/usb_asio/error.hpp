@@ -196,7 +196,7 @@ namespace usb_asio
                             std::bind_front(std::move(completion_handler), ec, std::move(result)));
                     });
             },
-            std::forward<CompletionToken>(token),
+            token,
             executor,
             blocking_op_executor,
             std::forward<BlockingFn>(blocking_fn));
@@ -240,7 +240,7 @@ namespace usb_asio
                             std::bind_front(std::move(completion_handler), ec));
                     });
             },
-            std::forward<CompletionToken>(token),
+            token,
             executor,
             blocking_op_executor,
             std::forward<BlockingFn>(blocking_fn));
@@ -42,6 +42,12 @@ namespace usb_asio
         out = ::LIBUSB_ENDPOINT_OUT,
     };
 
+    enum class usb_hotplug_event
+    {
+        arrived = ::LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+        left = ::LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+    };
+
     enum class usb_control_request_recipient
     {
         device = ::LIBUSB_RECIPIENT_DEVICE,
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "usb_asio/asio.hpp"
+
+namespace usb_asio::detail
+{
+    // Single block cache for the memory of one asynchronous operation.
+    // The block is first used by the type-erased handler, which is freed before
+    // the handler is posted, and then by the posted function, which asio frees
+    // before the upcall. An owner has at most one operation in flight,
+    // so one block is enough to make the steady state allocation-free.
+    class handler_memory
+    {
+      public:
+        handler_memory() noexcept = default;
+
+        handler_memory(handler_memory const&) = delete;
+
+        handler_memory(handler_memory&&) = delete;
+
+        ~handler_memory() noexcept
+        {
+            ::operator delete(block_, capacity_);
+        }
+
+        [[nodiscard]] auto allocate(std::size_t const size, std::size_t const alignment) -> void*
+        {
+            if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            {
+                return ::operator new(size, std::align_val_t{alignment});
+            }
+
+            if (in_use_)
+            {
+                return ::operator new(size);
+            }
+
+            if (size > capacity_)
+            {
+                ::operator delete(std::exchange(block_, nullptr), capacity_);
+                capacity_ = 0;
+
+                block_ = ::operator new(size);
+                capacity_ = size;
+            }
+
+            in_use_ = true;
+            return block_;
+        }
+
+        void deallocate(void* const ptr, std::size_t const size, std::size_t const alignment) noexcept
+        {
+            if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            {
+                ::operator delete(ptr, size, std::align_val_t{alignment});
+            }
+            else if (ptr == block_)
+            {
+                in_use_ = false;
+            }
+            else
+            {
+                ::operator delete(ptr, size);
+            }
+        }
+
+        auto operator=(handler_memory const&) = delete;
+
+        auto operator=(handler_memory&&) = delete;
+
+      private:
+        void* block_ = nullptr;
+        std::size_t capacity_ = 0;
+        bool in_use_ = false;
+    };
+
+    template <typename T>
+    class handler_allocator
+    {
+      public:
+        using value_type = T;
+
+        explicit handler_allocator(std::shared_ptr<handler_memory> memory) noexcept
+          : memory_{std::move(memory)} { }
+
+        template <typename U>
+        handler_allocator(handler_allocator<U> const& other) noexcept
+          : memory_{other.memory_} { }
+
+        [[nodiscard]] auto allocate(std::size_t const n) -> T*
+        {
+            return static_cast<T*>(memory_->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* const ptr, std::size_t const n) noexcept
+        {
+            memory_->deallocate(ptr, n * sizeof(T), alignof(T));
+        }
+
+        template <typename U>
+        [[nodiscard]] friend auto operator==(
+            handler_allocator const& lhs,
+            handler_allocator<U> const& rhs) noexcept -> bool
+        {
+            return lhs.memory_ == rhs.memory_;
+        }
+
+      private:
+        template <typename U>
+        friend class handler_allocator;
+
+        // Shared, as the posted function can outlive the owner of the memory
+        // (e.g. when the io_context is destroyed with pending handlers).
+        std::shared_ptr<handler_memory> memory_;
+    };
+
+    // Like std::bind_front, but with an associated allocator,
+    // so that asio can use it for the posted operation.
+    template <typename Alloc, typename Handler, typename... Args>
+    class bound_handler
+    {
+      public:
+        using allocator_type = Alloc;
+
+        template <typename OtherHandler, typename... BoundArgs>
+        bound_handler(Alloc const& alloc, OtherHandler&& handler, BoundArgs&&... args)
+          : alloc_{alloc}
+          , handler_{std::forward<OtherHandler>(handler)}
+          , args_{std::forward<BoundArgs>(args)...} { }
+
+        [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+        {
+            return alloc_;
+        }
+
+        void operator()()
+        {
+            std::apply(std::move(handler_), std::move(args_));
+        }
+
+      private:
+        Alloc alloc_;
+        Handler handler_;
+        std::tuple<Args...> args_;
+    };
+
+    template <typename Alloc, typename Handler, typename... Args>
+    [[nodiscard]] auto bind_handler(Alloc const& alloc, Handler&& handler, Args&&... args)
+    {
+        return bound_handler<Alloc, std::decay_t<Handler>, std::decay_t<Args>...>{
+            alloc,
+            std::forward<Handler>(handler),
+            std::forward<Args>(args)...,
+        };
+    }
+}  // namespace usb_asio::detail
@@ -4,9 +4,27 @@
 #include "usb_asio/error.hpp"
 #include "usb_asio/flags.hpp"
 #include "usb_asio/list_usb_devices.hpp"
+#include "usb_asio/usb_bulk_stream.hpp"
+#include "usb_asio/usb_bulk_stream_mux.hpp"
+#include "usb_asio/usb_deadline.hpp"
+#include "usb_asio/usb_descriptor_tree.hpp"
 #include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_device_bring_up.hpp"
 #include "usb_asio/usb_device_info.hpp"
+#include "usb_asio/usb_device_registry.hpp"
+#include "usb_asio/usb_dma_pool_resource.hpp"
 #include "usb_asio/usb_dma_resource.hpp"
+#include "usb_asio/usb_dma_synchronized_pool_resource.hpp"
 #include "usb_asio/usb_interface.hpp"
+#include "usb_asio/usb_iso_ring_reader.hpp"
+#include "usb_asio/usb_packet_io.hpp"
+#include "usb_asio/usb_request_pipeline.hpp"
 #include "usb_asio/usb_service.hpp"
+#include "usb_asio/usb_statistics.hpp"
 #include "usb_asio/usb_transfer.hpp"
+#include "usb_asio/usb_transfer_batch.hpp"
+#include "usb_asio/usb_transfer_pool.hpp"
+
+#ifdef __cpp_impl_coroutine
+#include "usb_asio/usb_transfer_awaiter.hpp"
+#endif
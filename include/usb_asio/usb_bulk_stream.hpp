@@ -0,0 +1,711 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    namespace detail
+    {
+        struct usb_bulk_stream_access;
+
+        // A queue of bulk transfers with buffers of a fixed size, kept in flight in submission order.
+        // Shared with the transfer handlers, so that it outlives pending transfers.
+        // The transfers of a bulk_stream queue all use the same stream id.
+        template <usb_transfer_direction direction, typename Executor, usb_transfer_type type>
+        class usb_bulk_transfer_queue
+          : public std::enable_shared_from_this<usb_bulk_transfer_queue<direction, Executor, type>>
+        {
+          public:
+            using transfer_type = basic_usb_transfer<type, direction, Executor>;
+
+            struct slot
+            {
+                transfer_type transfer;
+                std::byte* data;
+                std::size_t size = 0;
+                std::size_t consumed = 0;
+                error_code ec = {};
+                bool in_flight = false;
+            };
+
+            template <typename OtherExecutor>
+            usb_bulk_transfer_queue(
+                Executor const& executor,
+                basic_usb_device<OtherExecutor>& device,
+                std::uint8_t const endpoint,
+                std::uint32_t const stream_id,
+                std::size_t const queue_depth,
+                std::size_t const transfer_size,
+                std::chrono::milliseconds const timeout,
+                std::pmr::memory_resource* const mem_resource)
+              : transfer_size_{transfer_size}
+              , mem_resource_{mem_resource}
+            {
+                slots_.reserve(queue_depth);
+                try
+                {
+                    while (slots_.size() < std::max(queue_depth, std::size_t{1}))
+                    {
+                        auto const data = static_cast<std::byte*>(
+                            mem_resource_->allocate(transfer_size_, buffer_alignment));
+                        slots_.push_back(slot{
+                            make_transfer(executor, device, endpoint, stream_id, timeout),
+                            data,
+                        });
+                    }
+                }
+                catch (...)
+                {
+                    free_buffers();
+                    throw;
+                }
+            }
+
+            usb_bulk_transfer_queue(usb_bulk_transfer_queue const&) = delete;
+
+            ~usb_bulk_transfer_queue() noexcept
+            {
+                free_buffers();
+            }
+
+            [[nodiscard]] auto transfer_size() const noexcept -> std::size_t
+            {
+                return transfer_size_;
+            }
+
+            [[nodiscard]] auto slots() noexcept -> std::span<slot>
+            {
+                return slots_;
+            }
+
+            [[nodiscard]] auto in_flight() const noexcept -> std::size_t
+            {
+                return in_flight_;
+            }
+
+            void cancel() noexcept
+            {
+                for (auto& slot : slots_)
+                {
+                    if (slot.in_flight)
+                    {
+                        auto ec = error_code{};
+                        slot.transfer.cancel(ec);
+                    }
+                }
+            }
+
+            // Keeps the resource alive until the queue is destroyed, which is after its last transfer completed.
+            void keep_alive(std::shared_ptr<void const> resource) noexcept
+            {
+                keep_alive_ = std::move(resource);
+            }
+
+            auto operator=(usb_bulk_transfer_queue const&) = delete;
+
+          protected:
+            // Submits the slot, with the given buffer size, calling on_complete(slot) when done.
+            template <typename Derived>
+            void submit(std::size_t const index, std::size_t const size)
+            {
+                auto& slot = slots_[index];
+                slot.size = size;
+                slot.consumed = 0;
+                slot.ec.clear();
+                slot.in_flight = true;
+                ++in_flight_;
+
+                auto handler = [self = this->shared_from_this(), index](error_code const ec, std::size_t const transferred) {
+                    auto& slot = self->slots_[index];
+                    slot.in_flight = false;
+                    slot.ec = ec;
+                    slot.size = transferred;
+                    --self->in_flight_;
+
+                    static_cast<Derived&>(*self).on_complete(index);
+                };
+
+                if constexpr (direction == usb_transfer_direction::in)
+                {
+                    slot.transfer.async_read_some(asio::buffer(slot.data, size), handler);
+                }
+                else
+                {
+                    slot.transfer.async_write_some(asio::buffer(slot.data, size), handler);
+                }
+            }
+
+          private:
+            static constexpr auto buffer_alignment = alignof(std::max_align_t);
+
+            // Declared first, so that it is released after the transfers
+            std::shared_ptr<void const> keep_alive_;
+            std::vector<slot> slots_;
+            std::size_t transfer_size_;
+            std::pmr::memory_resource* mem_resource_;
+            std::size_t in_flight_ = 0;
+
+            template <typename OtherExecutor>
+            [[nodiscard]] static auto make_transfer(
+                Executor const& executor,
+                basic_usb_device<OtherExecutor>& device,
+                std::uint8_t const endpoint,
+                std::uint32_t const stream_id,
+                std::chrono::milliseconds const timeout) -> transfer_type
+            {
+                if constexpr (type == usb_transfer_type::bulk_stream)
+                {
+                    return transfer_type{executor, device, endpoint, stream_id, timeout};
+                }
+                else
+                {
+                    return transfer_type{executor, device, endpoint, timeout};
+                }
+            }
+
+            void free_buffers() noexcept
+            {
+                for (auto const& slot : slots_)
+                {
+                    mem_resource_->deallocate(slot.data, transfer_size_, buffer_alignment);
+                }
+                slots_.clear();
+            }
+        };
+    }  // namespace detail
+
+    // Reads a bulk IN endpoint continuously, keeping queue_depth transfers in flight.
+    // Satisfies the AsyncReadStream requirements, data are delivered in order.
+    // The first read starts the streaming, an error stops it and is reported
+    // after the data received before it.
+    // With usb_transfer_type::bulk_stream, reads one stream of a USB 3 bulk endpoint.
+    template <
+        typename Executor = asio::any_io_executor,
+        usb_transfer_type transfer_type = usb_transfer_type::bulk>
+    class basic_usb_bulk_stream_reader
+    {
+      public:
+        using executor_type = Executor;
+
+        // clang-format off
+        template <typename OtherExecutor>
+        basic_usb_bulk_stream_reader(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk)
+          // clang-format on
+          : executor_{executor}
+          , queue_{std::make_shared<queue>(
+                executor,
+                device,
+                endpoint,
+                std::uint32_t{0},
+                queue_depth,
+                transfer_size,
+                timeout,
+                mem_resource)}
+        {
+        }
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_bulk_stream_reader(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk)
+          // clang-format on
+          : basic_usb_bulk_stream_reader{
+              device.get_executor(),
+              device,
+              endpoint,
+              queue_depth,
+              transfer_size,
+              mem_resource,
+              timeout,
+          }
+        {
+        }
+
+        // clang-format off
+        template <typename OtherExecutor>
+        basic_usb_bulk_stream_reader(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::uint32_t const stream_id,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk_stream)
+          // clang-format on
+          : executor_{executor}
+          , queue_{std::make_shared<queue>(
+                executor,
+                device,
+                endpoint,
+                stream_id,
+                queue_depth,
+                transfer_size,
+                timeout,
+                mem_resource)}
+        {
+        }
+
+        basic_usb_bulk_stream_reader(basic_usb_bulk_stream_reader&&) noexcept = default;
+
+        ~basic_usb_bulk_stream_reader() noexcept
+        {
+            if (queue_ != nullptr)
+            {
+                queue_->stop();
+            }
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        // Stops the streaming, pending transfers complete with usb_transfer_errc::cancelled.
+        void cancel() noexcept
+        {
+            queue_->stop();
+        }
+
+        // clang-format off
+        template <
+            typename MutableBufferSequence,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_read_some(MutableBufferSequence const& buffers, CompletionToken&& token = {})
+        requires asio::is_mutable_buffer_sequence<MutableBufferSequence>::value
+        // clang-format on
+        {
+            return asio::async_initiate<CompletionToken, void(error_code, std::size_t)>(
+                [](auto completion_handler, queue& queue, auto const& buffers) {
+                    queue.read(buffers, std::move(completion_handler));
+                },
+                token,
+                std::ref(*queue_),
+                buffers);
+        }
+
+        auto operator=(basic_usb_bulk_stream_reader&&) noexcept -> basic_usb_bulk_stream_reader& = default;
+
+      private:
+        friend detail::usb_bulk_stream_access;
+
+        class queue final
+          : public detail::usb_bulk_transfer_queue<usb_transfer_direction::in, Executor, transfer_type>
+        {
+          public:
+            using base_type = detail::usb_bulk_transfer_queue<usb_transfer_direction::in, Executor, transfer_type>;
+
+            template <typename... Args>
+            explicit queue(Executor const& executor, Args&&... args)
+              : base_type{executor, std::forward<Args>(args)...}
+              , executor_{executor}
+            {
+            }
+
+            template <typename MutableBufferSequence, typename Handler>
+            void read(MutableBufferSequence const& buffers, Handler&& handler)
+            {
+                pending_read_.emplace(executor_, std::forward<Handler>(handler));
+
+                pending_buffers_.assign(
+                    asio::buffer_sequence_begin(buffers),
+                    asio::buffer_sequence_end(buffers));
+
+                if (!started_)
+                {
+                    started_ = true;
+                    for (auto index = std::size_t{0}; index < this->slots().size(); ++index)
+                    {
+                        this->template submit<queue>(index, this->transfer_size());
+                    }
+                }
+
+                // Not allowed to complete inline
+                try_complete_read(usb_completion_dispatch::post);
+            }
+
+            void stop() noexcept
+            {
+                stopped_ = true;
+                this->cancel();
+            }
+
+            void on_complete(std::size_t const index)
+            {
+                if (index == head_)
+                {
+                    try_complete_read(usb_completion_dispatch::dispatch);
+                }
+            }
+
+          private:
+            friend base_type;
+
+            Executor executor_;
+            std::size_t head_ = 0;
+            bool started_ = false;
+            bool stopped_ = false;
+            detail::completion_handler<Executor, error_code, std::size_t> pending_read_;
+            std::vector<asio::mutable_buffer> pending_buffers_;
+
+            void try_complete_read(usb_completion_dispatch const dispatch)
+            {
+                if (!pending_read_) { return; }
+
+                if (asio::buffer_size(pending_buffers_) == 0)
+                {
+                    pending_read_(dispatch, error_code{}, 0);
+                    return;
+                }
+
+                while (true)
+                {
+                    auto& slot = this->slots()[head_];
+                    if (slot.in_flight) { return; }
+
+                    if (slot.consumed < slot.size)
+                    {
+                        auto const copied = asio::buffer_copy(
+                            pending_buffers_,
+                            asio::buffer(slot.data + slot.consumed, slot.size - slot.consumed));
+                        slot.consumed += copied;
+
+                        if (slot.consumed == slot.size && !slot.ec)
+                        {
+                            recycle_head();
+                        }
+
+                        pending_read_(dispatch, error_code{}, copied);
+                        return;
+                    }
+
+                    if (slot.ec || stopped_)
+                    {
+                        // The streaming stops at the first error
+                        pending_read_(
+                            dispatch,
+                            slot.ec ? slot.ec : make_error_code(usb_transfer_errc::cancelled),
+                            0);
+                        return;
+                    }
+
+                    // Zero length packet, nothing to deliver
+                    recycle_head();
+                }
+            }
+
+            void recycle_head()
+            {
+                if (!stopped_)
+                {
+                    this->template submit<queue>(head_, this->transfer_size());
+                }
+                else
+                {
+                    this->slots()[head_].size = 0;
+                    this->slots()[head_].ec = make_error_code(usb_transfer_errc::cancelled);
+                }
+                head_ = (head_ + 1) % this->slots().size();
+            }
+        };
+
+        executor_type executor_;
+        std::shared_ptr<queue> queue_;
+    };
+
+    using usb_bulk_stream_reader = basic_usb_bulk_stream_reader<>;
+
+    // Writes to a bulk OUT endpoint, keeping up to queue_depth transfers in flight.
+    // Satisfies the AsyncWriteStream requirements. Written data are copied
+    // into the buffer of a free transfer (at most transfer_size bytes per write)
+    // and the write completes as soon as the transfer is submitted,
+    // so the device sees the data in the order of the writes.
+    // A transfer error is reported by the next write or flush, and stops the stream.
+    // With usb_transfer_type::bulk_stream, writes one stream of a USB 3 bulk endpoint.
+    template <
+        typename Executor = asio::any_io_executor,
+        usb_transfer_type transfer_type = usb_transfer_type::bulk>
+    class basic_usb_bulk_stream_writer
+    {
+      public:
+        using executor_type = Executor;
+
+        // clang-format off
+        template <typename OtherExecutor>
+        basic_usb_bulk_stream_writer(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk)
+          // clang-format on
+          : executor_{executor}
+          , queue_{std::make_shared<queue>(
+                executor,
+                device,
+                endpoint,
+                std::uint32_t{0},
+                queue_depth,
+                transfer_size,
+                timeout,
+                mem_resource)}
+        {
+        }
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_bulk_stream_writer(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk)
+          // clang-format on
+          : basic_usb_bulk_stream_writer{
+              device.get_executor(),
+              device,
+              endpoint,
+              queue_depth,
+              transfer_size,
+              mem_resource,
+              timeout,
+          }
+        {
+        }
+
+        // clang-format off
+        template <typename OtherExecutor>
+        basic_usb_bulk_stream_writer(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::uint32_t const stream_id,
+            std::size_t const queue_depth,
+            std::size_t const transfer_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk_stream)
+          // clang-format on
+          : executor_{executor}
+          , queue_{std::make_shared<queue>(
+                executor,
+                device,
+                endpoint,
+                stream_id,
+                queue_depth,
+                transfer_size,
+                timeout,
+                mem_resource)}
+        {
+        }
+
+        basic_usb_bulk_stream_writer(basic_usb_bulk_stream_writer&&) noexcept = default;
+
+        ~basic_usb_bulk_stream_writer() noexcept
+        {
+            if (queue_ != nullptr)
+            {
+                queue_->stop();
+            }
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        void cancel() noexcept
+        {
+            queue_->stop();
+        }
+
+        // clang-format off
+        template <
+            typename ConstBufferSequence,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_write_some(ConstBufferSequence const& buffers, CompletionToken&& token = {})
+        requires asio::is_const_buffer_sequence<ConstBufferSequence>::value
+        // clang-format on
+        {
+            return asio::async_initiate<CompletionToken, void(error_code, std::size_t)>(
+                [](auto completion_handler, queue& queue, auto const& buffers) {
+                    queue.write(buffers, std::move(completion_handler));
+                },
+                token,
+                std::ref(*queue_),
+                buffers);
+        }
+
+        // Completes when all submitted transfers are done.
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_flush(CompletionToken&& token = {})
+        {
+            return asio::async_initiate<CompletionToken, void(error_code)>(
+                [](auto completion_handler, queue& queue) {
+                    queue.flush(std::move(completion_handler));
+                },
+                token,
+                std::ref(*queue_));
+        }
+
+        auto operator=(basic_usb_bulk_stream_writer&&) noexcept -> basic_usb_bulk_stream_writer& = default;
+
+      private:
+        friend detail::usb_bulk_stream_access;
+
+        class queue final
+          : public detail::usb_bulk_transfer_queue<usb_transfer_direction::out, Executor, transfer_type>
+        {
+          public:
+            using base_type = detail::usb_bulk_transfer_queue<usb_transfer_direction::out, Executor, transfer_type>;
+
+            template <typename... Args>
+            explicit queue(Executor const& executor, Args&&... args)
+              : base_type{executor, std::forward<Args>(args)...}
+              , executor_{executor}
+            {
+            }
+
+            template <typename ConstBufferSequence, typename Handler>
+            void write(ConstBufferSequence const& buffers, Handler&& handler)
+            {
+                pending_write_.emplace(executor_, std::forward<Handler>(handler));
+
+                pending_buffers_.assign(
+                    asio::buffer_sequence_begin(buffers),
+                    asio::buffer_sequence_end(buffers));
+
+                // Not allowed to complete inline
+                try_complete_write(usb_completion_dispatch::post);
+            }
+
+            template <typename Handler>
+            void flush(Handler&& handler)
+            {
+                pending_flush_.emplace(executor_, std::forward<Handler>(handler));
+                try_complete_flush(usb_completion_dispatch::post);
+            }
+
+            void stop() noexcept
+            {
+                if (!ec_)
+                {
+                    ec_ = make_error_code(usb_transfer_errc::cancelled);
+                }
+                this->cancel();
+            }
+
+            void on_complete(std::size_t const index)
+            {
+                if (auto const& slot = this->slots()[index]; slot.ec && !ec_)
+                {
+                    ec_ = slot.ec;
+                }
+
+                try_complete_write(usb_completion_dispatch::dispatch);
+                try_complete_flush(usb_completion_dispatch::dispatch);
+            }
+
+          private:
+            friend base_type;
+
+            Executor executor_;
+            std::size_t tail_ = 0;
+            error_code ec_;
+            detail::completion_handler<Executor, error_code, std::size_t> pending_write_;
+            detail::completion_handler<Executor, error_code> pending_flush_;
+            std::vector<asio::const_buffer> pending_buffers_;
+
+            void try_complete_write(usb_completion_dispatch const dispatch)
+            {
+                if (!pending_write_) { return; }
+
+                if (ec_)
+                {
+                    pending_write_(dispatch, ec_, 0);
+                    return;
+                }
+
+                auto const size = asio::buffer_size(pending_buffers_);
+                if (size == 0)
+                {
+                    pending_write_(dispatch, error_code{}, 0);
+                    return;
+                }
+
+                // Transfers complete in order, so the tail is the oldest one
+                auto& slot = this->slots()[tail_];
+                if (slot.in_flight) { return; }
+
+                auto const copied = asio::buffer_copy(
+                    asio::buffer(slot.data, this->transfer_size()),
+                    pending_buffers_);
+                this->template submit<queue>(tail_, copied);
+                tail_ = (tail_ + 1) % this->slots().size();
+
+                pending_write_(dispatch, error_code{}, copied);
+            }
+
+            void try_complete_flush(usb_completion_dispatch const dispatch)
+            {
+                if (pending_flush_ && this->in_flight() == 0)
+                {
+                    pending_flush_(dispatch, ec_);
+                }
+            }
+        };
+
+        executor_type executor_;
+        std::shared_ptr<queue> queue_;
+    };
+
+    using usb_bulk_stream_writer = basic_usb_bulk_stream_writer<>;
+
+    namespace detail
+    {
+        // The transfer queue of a basic_usb_bulk_stream_reader or basic_usb_bulk_stream_writer
+        struct usb_bulk_stream_access
+        {
+            template <typename Channel>
+            [[nodiscard]] static auto queue(Channel& channel) noexcept -> auto&
+            {
+                return *channel.queue_;
+            }
+        };
+    }  // namespace detail
+}  // namespace usb_asio
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_bulk_stream.hpp"
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    struct usb_bulk_stream_mux_options
+    {
+        // Requested from the device, which may allocate fewer.
+        std::uint32_t num_streams = 16;
+        // Transfers in flight per stream.
+        std::size_t queue_depth = 2;
+        std::size_t transfer_size = 16384;
+        std::pmr::memory_resource* mem_resource = std::pmr::get_default_resource();
+        std::chrono::milliseconds timeout = usb_no_timeout;
+    };
+
+    namespace detail
+    {
+        // Frees the streams of an endpoint on destruction.
+        // Shared by the transfer queues of the channels of a mux, so that the streams
+        // are freed after the last transfer using them completed.
+        class usb_bulk_streams
+        {
+          public:
+            usb_bulk_streams(::libusb_device_handle* const device_handle, std::uint8_t const endpoint) noexcept
+              : device_handle_{device_handle}
+              , endpoint_{endpoint}
+            {
+            }
+
+            usb_bulk_streams(usb_bulk_streams const&) = delete;
+
+            ~usb_bulk_streams() noexcept
+            {
+                auto ec = error_code{};
+                libusb_try(ec, &::libusb_free_streams, device_handle_, &endpoint_, 1);
+            }
+
+            auto operator=(usb_bulk_streams const&) = delete;
+
+          private:
+            ::libusb_device_handle* device_handle_;
+            std::uint8_t endpoint_;
+        };
+    }  // namespace detail
+
+    // Allocates the streams of a USB 3 bulk endpoint, and exposes each stream as an independent
+    // channel keeping options.queue_depth transfers in flight: a basic_usb_bulk_stream_reader
+    // for an IN endpoint, a basic_usb_bulk_stream_writer for an OUT endpoint.
+    // Destruction cancels the pending transfers of all channels; the streams are freed
+    // once the last of them completed, so the device must stay open until then.
+    template <usb_transfer_direction direction, typename Executor = asio::any_io_executor>
+    class basic_usb_bulk_stream_mux
+    {
+      public:
+        using executor_type = Executor;
+        using channel_type = std::conditional_t<
+            direction == usb_transfer_direction::in,
+            basic_usb_bulk_stream_reader<Executor, usb_transfer_type::bulk_stream>,
+            basic_usb_bulk_stream_writer<Executor, usb_transfer_type::bulk_stream>>;
+
+        template <typename OtherExecutor>
+        basic_usb_bulk_stream_mux(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            usb_bulk_stream_mux_options const& options = {})
+          : executor_{executor}
+          , endpoint_{endpoint}
+        {
+            auto const endpoints = std::span{&endpoint_, 1};
+            auto const num_streams = device.alloc_streams(options.num_streams, endpoints);
+            // Released by the last channel queue, or on scope exit if none was created
+            auto const streams = std::make_shared<detail::usb_bulk_streams const>(device.handle(), endpoint);
+
+            channels_.reserve(num_streams);
+            // Stream ids start at 1
+            for (auto stream_id = std::uint32_t{1}; stream_id <= num_streams; ++stream_id)
+            {
+                channels_.emplace_back(
+                    executor,
+                    device,
+                    endpoint,
+                    stream_id,
+                    options.queue_depth,
+                    options.transfer_size,
+                    options.mem_resource,
+                    options.timeout);
+                detail::usb_bulk_stream_access::queue(channels_.back()).keep_alive(streams);
+            }
+        }
+
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_bulk_stream_mux(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            usb_bulk_stream_mux_options const& options = {})
+          : basic_usb_bulk_stream_mux{device.get_executor(), device, endpoint, options}
+        {
+        }
+
+        basic_usb_bulk_stream_mux(basic_usb_bulk_stream_mux const&) = delete;
+
+        basic_usb_bulk_stream_mux(basic_usb_bulk_stream_mux&&) noexcept = default;
+
+        ~basic_usb_bulk_stream_mux() noexcept = default;
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        [[nodiscard]] auto endpoint() const noexcept -> std::uint8_t
+        {
+            return endpoint_;
+        }
+
+        [[nodiscard]] auto num_streams() const noexcept -> std::uint32_t
+        {
+            return static_cast<std::uint32_t>(channels_.size());
+        }
+
+        // The channel of a stream id, from 1 to num_streams().
+        [[nodiscard]] auto stream(std::uint32_t const stream_id) noexcept -> channel_type&
+        {
+            return channels_[stream_id - 1u];
+        }
+
+        // Stops the streaming of all channels.
+        void cancel() noexcept
+        {
+            for (auto& channel : channels_)
+            {
+                channel.cancel();
+            }
+        }
+
+        auto operator=(basic_usb_bulk_stream_mux const&) = delete;
+
+        auto operator=(basic_usb_bulk_stream_mux&&) noexcept -> basic_usb_bulk_stream_mux& = default;
+
+      private:
+        executor_type executor_;
+        std::uint8_t endpoint_;
+        std::vector<channel_type> channels_;
+    };
+
+    template <typename Executor = asio::any_io_executor>
+    using basic_usb_in_bulk_stream_mux = basic_usb_bulk_stream_mux<usb_transfer_direction::in, Executor>;
+    using usb_in_bulk_stream_mux = basic_usb_in_bulk_stream_mux<>;
+
+    template <typename Executor = asio::any_io_executor>
+    using basic_usb_out_bulk_stream_mux = basic_usb_bulk_stream_mux<usb_transfer_direction::out, Executor>;
+    using usb_out_bulk_stream_mux = basic_usb_out_bulk_stream_mux<>;
+}  // namespace usb_asio
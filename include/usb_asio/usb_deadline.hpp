@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/error.hpp"
+
+namespace usb_asio
+{
+    // Completion token adapter giving a transfer operation a deadline. When it expires,
+    // the transfer is cancelled and completes with usb_transfer_errc::timeout, the code of the libusb
+    // transfer timeout (LIBUSB_TRANSFER_TIMED_OUT), so that both kinds of timeout are handled alike:
+    //   transfer.async_read_some(buffer, usb_asio::with_deadline(std::chrono::milliseconds{50}, handler));
+    // The deadline replaces neither the timeout the transfer was constructed with,
+    // nor cancellation by other means.
+    template <typename CompletionToken>
+    struct usb_deadline_t
+    {
+        std::chrono::nanoseconds timeout;
+        CompletionToken token;
+    };
+
+    template <typename CompletionToken>
+    [[nodiscard]] auto with_deadline(std::chrono::nanoseconds const timeout, CompletionToken&& token)
+        -> usb_deadline_t<std::decay_t<CompletionToken>>
+    {
+        return usb_deadline_t<std::decay_t<CompletionToken>>{timeout, std::forward<CompletionToken>(token)};
+    }
+
+    namespace detail
+    {
+        template <typename T>
+        inline constexpr bool is_usb_deadline_token = false;
+
+        template <typename CompletionToken>
+        inline constexpr bool is_usb_deadline_token<usb_deadline_t<CompletionToken>> = true;
+
+        class usb_timer_wheel;
+
+        // The deadline of the operation of a transfer, part of the transfer so that arming it does not allocate.
+        struct usb_deadline
+        {
+            enum class state_type
+            {
+                idle,
+                // Armed while the operation is being submitted
+                submitting,
+                armed,
+                // Expired while submitting, cancelled once the submission is done
+                expired_submitting,
+                expired,
+            };
+
+            // Cancels the transfer, called with the wheel locked, on the thread of the wheel or the submitting one
+            void (*expire)(::libusb_transfer*) noexcept = nullptr;
+            ::libusb_transfer* transfer = nullptr;
+            // Set while armed, by the thread submitting the operation and then the one completing it
+            usb_timer_wheel* wheel = nullptr;
+
+            // Guarded by the wheel
+            state_type state = state_type::idle;
+            // Bumped when armed, so that a submission does not act on the deadline of a later operation
+            std::uint64_t generation = 0;
+            std::uint64_t expiry_tick = 0;
+            usb_deadline* prev = nullptr;
+            usb_deadline* next = nullptr;
+        };
+
+        // Hashed timer wheel expiring the deadlines of the transfer operations of a service.
+        // Arming and disarming a deadline take constant time, and the thread of the wheel
+        // only ticks while deadlines are armed. Deadlines expire up to one resolution late.
+        class usb_timer_wheel
+        {
+          public:
+            static constexpr auto num_slots = std::size_t{512};
+
+            explicit usb_timer_wheel(std::chrono::nanoseconds const resolution)
+              : resolution_{std::max(
+                  std::chrono::duration_cast<clock::duration>(resolution),
+                  clock::duration{1})}
+              , slots_(num_slots, nullptr)
+              , thread_{[this](std::stop_token const& stop_token) { run(stop_token); }}
+            {
+            }
+
+            usb_timer_wheel(usb_timer_wheel const&) = delete;
+
+            usb_timer_wheel(usb_timer_wheel&&) = delete;
+
+            // Arms the deadline and submits the operation with submit(ec). The operation may complete
+            // before the submission returns, so the wheel is not locked while submitting.
+            // A deadline expiring meanwhile cancels the operation once the submission is done.
+            template <typename SubmitFn>
+            void submit(
+                usb_deadline& deadline,
+                std::chrono::nanoseconds const timeout,
+                SubmitFn&& submit,
+                error_code& ec)
+            {
+                auto generation = std::uint64_t{0};
+                {
+                    auto const lock = std::lock_guard{mutex_};
+                    arm(deadline, timeout);
+                    generation = deadline.generation;
+                }
+
+                std::invoke(std::forward<SubmitFn>(submit), ec);
+
+                auto const lock = std::lock_guard{mutex_};
+                // Completed, and possibly submitted again, meanwhile
+                if (deadline.generation != generation) { return; }
+
+                switch (deadline.state)
+                {
+                    case usb_deadline::state_type::submitting:
+                        if (ec)
+                        {
+                            unlink(deadline);
+                            --num_armed_;
+                            deadline.wheel = nullptr;
+                            deadline.state = usb_deadline::state_type::idle;
+                        }
+                        else
+                        {
+                            deadline.state = usb_deadline::state_type::armed;
+                        }
+                        break;
+                    case usb_deadline::state_type::expired_submitting:
+                        if (ec)
+                        {
+                            deadline.wheel = nullptr;
+                            deadline.state = usb_deadline::state_type::idle;
+                        }
+                        else
+                        {
+                            deadline.state = usb_deadline::state_type::expired;
+                            deadline.expire(deadline.transfer);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            // Returns whether the deadline expired.
+            [[nodiscard]] auto disarm(usb_deadline& deadline) noexcept -> bool
+            {
+                auto const lock = std::lock_guard{mutex_};
+
+                deadline.wheel = nullptr;
+                auto const state = std::exchange(deadline.state, usb_deadline::state_type::idle);
+                if (state == usb_deadline::state_type::armed || state == usb_deadline::state_type::submitting)
+                {
+                    unlink(deadline);
+                    --num_armed_;
+                }
+                return state == usb_deadline::state_type::expired;
+            }
+
+            auto operator=(usb_timer_wheel const&) = delete;
+
+            auto operator=(usb_timer_wheel&&) = delete;
+
+          private:
+            using clock = std::chrono::steady_clock;
+
+            clock::duration resolution_;
+            clock::time_point start_ = clock::now();
+            std::mutex mutex_;
+            std::condition_variable_any cv_;
+            // Heads of the lists of the deadlines expiring at ticks equal modulo num_slots
+            std::vector<usb_deadline*> slots_;
+            std::uint64_t current_tick_ = 0;
+            std::size_t num_armed_ = 0;
+            std::jthread thread_;
+
+            [[nodiscard]] auto tick_of(clock::time_point const time) const noexcept -> std::uint64_t
+            {
+                return static_cast<std::uint64_t>((time - start_) / resolution_);
+            }
+
+            // Requires the lock
+            void arm(usb_deadline& deadline, std::chrono::nanoseconds const timeout) noexcept
+            {
+                auto const now = clock::now();
+                if (num_armed_++ == 0)
+                {
+                    // Skip the ticks passed while idle
+                    current_tick_ = tick_of(now);
+                    cv_.notify_one();
+                }
+
+                deadline.wheel = this;
+                deadline.state = usb_deadline::state_type::submitting;
+                ++deadline.generation;
+                deadline.expiry_tick = tick_of(now + std::chrono::duration_cast<clock::duration>(timeout)) + 1u;
+                link(deadline);
+            }
+
+            void link(usb_deadline& deadline) noexcept
+            {
+                auto& head = slots_[deadline.expiry_tick % num_slots];
+                deadline.prev = nullptr;
+                deadline.next = head;
+                if (head != nullptr) { head->prev = &deadline; }
+                head = &deadline;
+            }
+
+            void unlink(usb_deadline& deadline) noexcept
+            {
+                if (deadline.prev != nullptr)
+                {
+                    deadline.prev->next = deadline.next;
+                }
+                else
+                {
+                    slots_[deadline.expiry_tick % num_slots] = deadline.next;
+                }
+                if (deadline.next != nullptr) { deadline.next->prev = deadline.prev; }
+                deadline.prev = nullptr;
+                deadline.next = nullptr;
+            }
+
+            void run(std::stop_token const& stop_token) noexcept
+            {
+                auto lock = std::unique_lock{mutex_};
+                while (true)
+                {
+                    if (!cv_.wait(lock, stop_token, [&]() { return num_armed_ > 0; }))
+                    {
+                        break;
+                    }
+
+                    auto const next_tick = start_ + resolution_ * static_cast<clock::rep>(current_tick_ + 1u);
+                    static_cast<void>(cv_.wait_until(lock, stop_token, next_tick, []() { return false; }));
+                    if (stop_token.stop_requested())
+                    {
+                        break;
+                    }
+
+                    auto const now_tick = tick_of(clock::now());
+                    while (current_tick_ < now_tick && num_armed_ > 0)
+                    {
+                        ++current_tick_;
+                        expire_slot();
+                    }
+                }
+            }
+
+            // Expires the deadlines of the current tick, leaving those of later rounds of the wheel
+            void expire_slot() noexcept
+            {
+                auto deadline = slots_[current_tick_ % num_slots];
+                while (deadline != nullptr)
+                {
+                    auto const next = deadline->next;
+                    if (deadline->expiry_tick <= current_tick_)
+                    {
+                        unlink(*deadline);
+                        --num_armed_;
+                        if (deadline->state == usb_deadline::state_type::submitting)
+                        {
+                            // Cancelling now could miss the transfers not yet submitted
+                            deadline->state = usb_deadline::state_type::expired_submitting;
+                        }
+                        else
+                        {
+                            deadline->state = usb_deadline::state_type::expired;
+                            deadline->expire(deadline->transfer);
+                        }
+                    }
+                    deadline = next;
+                }
+            }
+        };
+    }  // namespace detail
+}  // namespace usb_asio
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/error.hpp"
+#include "usb_asio/flags.hpp"
+#include "usb_asio/libusb_ptr.hpp"
+
+namespace usb_asio
+{
+    struct usb_endpoint_node
+    {
+        std::uint8_t address;
+        std::uint8_t attributes;
+        std::uint16_t max_packet_size;
+        std::uint8_t interval;
+        std::uint8_t refresh;
+        std::uint8_t synch_address;
+
+        [[nodiscard]] auto transfer_type() const noexcept -> usb_transfer_type
+        {
+            return static_cast<usb_transfer_type>(attributes & LIBUSB_TRANSFER_TYPE_MASK);
+        }
+
+        [[nodiscard]] auto direction() const noexcept -> usb_transfer_direction
+        {
+            return static_cast<usb_transfer_direction>(address & LIBUSB_ENDPOINT_DIR_MASK);
+        }
+    };
+
+    struct usb_alt_setting_node
+    {
+        std::uint8_t interface_number;
+        std::uint8_t alt_setting;
+        std::uint8_t interface_class;
+        std::uint8_t interface_subclass;
+        std::uint8_t interface_protocol;
+        std::uint8_t interface_string_index;
+        std::uint16_t first_endpoint;
+        std::uint16_t num_endpoints;
+        // Endpoint index relative to first_endpoint, by endpoint slot
+        std::array<std::uint8_t, 32> endpoint_slots;
+    };
+
+    struct usb_interface_node
+    {
+        std::uint16_t first_alt_setting;
+        std::uint16_t num_alt_settings;
+    };
+
+    struct usb_config_node
+    {
+        std::uint8_t config_value;
+        std::uint8_t config_string_index;
+        std::uint8_t attributes;
+        std::uint8_t max_power;
+        std::uint16_t first_interface;
+        std::uint16_t num_interfaces;
+        // Index of the endpoint in the default alt settings, by endpoint slot
+        std::array<std::uint16_t, 32> endpoint_slots;
+    };
+
+    // Immutable copy of all descriptors of a device, in flat arrays indexed by the parent nodes.
+    // Endpoint lookup by address is a table lookup.
+    class usb_descriptor_tree
+    {
+      public:
+        using device_handle_type = ::libusb_device*;
+        using config_descriptor_ptr = libusb_ptr<
+            ::libusb_config_descriptor,
+            &::libusb_free_config_descriptor>;
+
+        usb_descriptor_tree() noexcept = default;
+
+        explicit usb_descriptor_tree(device_handle_type const device)
+        {
+            try_with_ec([&](auto& ec) {
+                build(device, ec);
+            });
+        }
+
+        usb_descriptor_tree(device_handle_type const device, error_code& ec) noexcept
+        {
+            try
+            {
+                build(device, ec);
+            }
+            catch (std::bad_alloc const&)
+            {
+                ec = make_error_code(usb_errc::no_mem);
+            }
+        }
+
+        [[nodiscard]] auto device_descriptor() const noexcept -> ::libusb_device_descriptor const&
+        {
+            return device_descriptor_;
+        }
+
+        // Configurations, by index.
+        [[nodiscard]] auto configs() const noexcept -> std::span<usb_config_node const>
+        {
+            return configs_;
+        }
+
+        [[nodiscard]] auto config_by_value(std::uint8_t const config_value) const noexcept
+            -> usb_config_node const*
+        {
+            for (auto const& config : configs_)
+            {
+                if (config.config_value == config_value) { return &config; }
+            }
+
+            return nullptr;
+        }
+
+        [[nodiscard]] auto interfaces(usb_config_node const& config) const noexcept
+            -> std::span<usb_interface_node const>
+        {
+            return std::span{interfaces_}.subspan(config.first_interface, config.num_interfaces);
+        }
+
+        [[nodiscard]] auto alt_settings(usb_interface_node const& interface) const noexcept
+            -> std::span<usb_alt_setting_node const>
+        {
+            return std::span{alt_settings_}.subspan(interface.first_alt_setting, interface.num_alt_settings);
+        }
+
+        [[nodiscard]] auto endpoints(usb_alt_setting_node const& alt_setting) const noexcept
+            -> std::span<usb_endpoint_node const>
+        {
+            return std::span{endpoints_}.subspan(alt_setting.first_endpoint, alt_setting.num_endpoints);
+        }
+
+        [[nodiscard]] auto find_endpoint(
+            usb_alt_setting_node const& alt_setting,
+            std::uint8_t const address) const noexcept
+            -> usb_endpoint_node const*
+        {
+            auto const index = alt_setting.endpoint_slots[endpoint_slot(address)];
+            if (index == no_alt_setting_endpoint) { return nullptr; }
+
+            return &endpoints_[alt_setting.first_endpoint + index];
+        }
+
+        // Looks the endpoint up in the default alt settings of the interfaces.
+        [[nodiscard]] auto find_endpoint(
+            usb_config_node const& config,
+            std::uint8_t const address) const noexcept
+            -> usb_endpoint_node const*
+        {
+            auto const index = config.endpoint_slots[endpoint_slot(address)];
+            if (index == no_config_endpoint) { return nullptr; }
+
+            return &endpoints_[index];
+        }
+
+      private:
+        static constexpr auto no_alt_setting_endpoint = std::uint8_t{0xFFu};
+        static constexpr auto no_config_endpoint = std::uint16_t{0xFFFFu};
+
+        ::libusb_device_descriptor device_descriptor_ = {};
+        std::vector<usb_config_node> configs_;
+        std::vector<usb_interface_node> interfaces_;
+        std::vector<usb_alt_setting_node> alt_settings_;
+        std::vector<usb_endpoint_node> endpoints_;
+
+        [[nodiscard]] static auto endpoint_slot(std::uint8_t const address) noexcept -> std::size_t
+        {
+            return (address & LIBUSB_ENDPOINT_ADDRESS_MASK) | ((address & LIBUSB_ENDPOINT_DIR_MASK) >> 3u);
+        }
+
+        void build(device_handle_type const device, error_code& ec)
+        {
+            libusb_try(ec, &::libusb_get_device_descriptor, device, &device_descriptor_);
+            if (ec) { return; }
+
+            configs_.reserve(device_descriptor_.bNumConfigurations);
+            for (auto config_index = std::uint8_t{0};
+                 config_index < device_descriptor_.bNumConfigurations;
+                 ++config_index)
+            {
+                auto descriptor = config_descriptor_ptr::pointer{};
+                libusb_try(ec, &::libusb_get_config_descriptor, device, config_index, &descriptor);
+                if (ec) { return; }
+
+                add_config(*config_descriptor_ptr{descriptor});
+            }
+        }
+
+        void add_config(::libusb_config_descriptor const& descriptor)
+        {
+            auto& config = configs_.emplace_back(usb_config_node{
+                .config_value = descriptor.bConfigurationValue,
+                .config_string_index = descriptor.iConfiguration,
+                .attributes = descriptor.bmAttributes,
+                .max_power = descriptor.MaxPower,
+                .first_interface = static_cast<std::uint16_t>(interfaces_.size()),
+                .num_interfaces = descriptor.bNumInterfaces,
+                .endpoint_slots = {},
+            });
+            config.endpoint_slots.fill(no_config_endpoint);
+
+            for (auto const& interface : std::span{descriptor.interface, descriptor.bNumInterfaces})
+            {
+                interfaces_.push_back(usb_interface_node{
+                    .first_alt_setting = static_cast<std::uint16_t>(alt_settings_.size()),
+                    .num_alt_settings = static_cast<std::uint16_t>(interface.num_altsetting),
+                });
+
+                auto const alt_setting_descriptors = std::span{
+                    interface.altsetting,
+                    static_cast<std::size_t>(interface.num_altsetting),
+                };
+                for (auto const& alt_setting_descriptor : alt_setting_descriptors)
+                {
+                    auto const& alt_setting = add_alt_setting(alt_setting_descriptor);
+
+                    if (alt_setting.alt_setting != 0) { continue; }
+
+                    for (auto index = std::uint16_t{0}; index < alt_setting.num_endpoints; ++index)
+                    {
+                        auto const endpoint_index = static_cast<std::uint16_t>(alt_setting.first_endpoint + index);
+                        config.endpoint_slots[endpoint_slot(endpoints_[endpoint_index].address)] = endpoint_index;
+                    }
+                }
+            }
+        }
+
+        auto add_alt_setting(::libusb_interface_descriptor const& descriptor) -> usb_alt_setting_node const&
+        {
+            auto& alt_setting = alt_settings_.emplace_back(usb_alt_setting_node{
+                .interface_number = descriptor.bInterfaceNumber,
+                .alt_setting = descriptor.bAlternateSetting,
+                .interface_class = descriptor.bInterfaceClass,
+                .interface_subclass = descriptor.bInterfaceSubClass,
+                .interface_protocol = descriptor.bInterfaceProtocol,
+                .interface_string_index = descriptor.iInterface,
+                .first_endpoint = static_cast<std::uint16_t>(endpoints_.size()),
+                .num_endpoints = descriptor.bNumEndpoints,
+                .endpoint_slots = {},
+            });
+            alt_setting.endpoint_slots.fill(no_alt_setting_endpoint);
+
+            for (auto const& endpoint : std::span{descriptor.endpoint, descriptor.bNumEndpoints})
+            {
+                alt_setting.endpoint_slots[endpoint_slot(endpoint.bEndpointAddress)] =
+                    static_cast<std::uint8_t>(endpoints_.size() - alt_setting.first_endpoint);
+
+                endpoints_.push_back(usb_endpoint_node{
+                    .address = endpoint.bEndpointAddress,
+                    .attributes = endpoint.bmAttributes,
+                    .max_packet_size = endpoint.wMaxPacketSize,
+                    .interval = endpoint.bInterval,
+                    .refresh = endpoint.bRefresh,
+                    .synch_address = endpoint.bSynchAddress,
+                });
+            }
+
+            return alt_setting;
+        }
+    };
+
+    namespace detail
+    {
+        // Descriptor trees of the devices, built once per libusb device.
+        // A tree keeps a reference to its device, so that a device pointer
+        // is not reused while the tree is alive.
+        class usb_descriptor_tree_cache
+        {
+          public:
+            using device_handle_type = ::libusb_device*;
+            using device_ref_type = libusb_ref_ptr<
+                ::libusb_device,
+                &::libusb_ref_device,
+                &::libusb_unref_device>;
+
+            [[nodiscard]] static auto get(device_handle_type const device, error_code& ec)
+                -> std::shared_ptr<usb_descriptor_tree const>
+            {
+                auto& cache = instance();
+                auto const lock = std::lock_guard{cache.mutex_};
+
+                if (auto const iter = cache.trees_.find(device); iter != cache.trees_.end())
+                {
+                    if (auto tree = iter->second.lock()) { return tree; }
+                }
+
+                auto owner = std::make_shared<owned_tree>(device, ec);
+                if (ec) { return nullptr; }
+                auto tree = std::shared_ptr<usb_descriptor_tree const>{owner, &owner->tree};
+
+                std::erase_if(cache.trees_, [](auto const& entry) {
+                    return entry.second.expired();
+                });
+                cache.trees_.insert_or_assign(device, tree);
+
+                return tree;
+            }
+
+          private:
+            struct owned_tree
+            {
+                device_ref_type device;
+                usb_descriptor_tree tree;
+
+                owned_tree(device_handle_type const device, error_code& ec) noexcept
+                  : device{device}
+                  , tree{device, ec} { }
+            };
+
+            std::mutex mutex_;
+            std::unordered_map<device_handle_type, std::weak_ptr<usb_descriptor_tree const>> trees_;
+
+            [[nodiscard]] static auto instance() -> usb_descriptor_tree_cache&
+            {
+                static auto cache = usb_descriptor_tree_cache{};
+                return cache;
+            }
+        };
+    }  // namespace detail
+}  // namespace usb_asio
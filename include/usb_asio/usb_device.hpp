@@ -2,7 +2,9 @@
 
 #include <concepts>
 #include <compare>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <span>
 
 #include <libusb.h>
@@ -11,6 +13,7 @@
 #include "usb_asio/libusb_ptr.hpp"
 #include "usb_asio/usb_device_info.hpp"
 #include "usb_asio/usb_service.hpp"
+#include "usb_asio/usb_statistics.hpp"
 
 namespace usb_asio
 {
@@ -26,6 +29,7 @@ namespace usb_asio
         explicit basic_usb_device(executor_type const& executor)
           : executor_{executor}
           , service_{&asio::use_service<service_type>(asio::query(executor, asio::execution::context))}
+          , statistics_{detail::make_usb_device_statistics()}
         {
         }
 
@@ -50,12 +54,19 @@ namespace usb_asio
         template <std::convertible_to<executor_type> OtherExecutor>
         basic_usb_device(basic_usb_device<OtherExecutor>&& other) noexcept
           : handle_{std::exchange(other.handle_, nullptr)}
+          , event_shard_{other.event_shard_}
           , executor_{other.executor_}
           , service_{other.service_}
+          , statistics_{other.statistics_}
         {
         }
 
-        void open(usb_device_info const& info) noexcept
+        ~basic_usb_device() noexcept
+        {
+            close();
+        }
+
+        void open(usb_device_info const& info)
         {
             try_with_ec([&](auto& ec) {
                 open(info, ec);
@@ -66,20 +77,33 @@ namespace usb_asio
         {
             close();
 
-            auto handle = handle_type{};
-            libusb_try(ec, &::libusb_open, info.handle(), &handle);
+            auto const handle = service_->open_device(info, event_shard_, ec);
             if (ec) { return; }
 
             handle_ = unique_handle_type{handle};
-            service_->notify_dev_opened();
+        }
+
+        // Opens the device on the service's blocking op threads, so that the libusb_open
+        // does not block the executor. The device must not be used until the operation completes.
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_open(
+            usb_device_info const& info,
+            CompletionToken&& token = {})
+        {
+            return async_try_blocking_with_ec(
+                executor_,
+                service_->blocking_op_executor(),
+                std::forward<CompletionToken>(token),
+                [this, info](auto& ec) {
+                    open(info, ec);
+                });
         }
 
         void close() noexcept
         {
             if (is_open())
             {
-                service_->notify_dev_closed();
-                handle_.reset();
+                service_->close_device(handle_.release(), event_shard_);
             }
         }
 
@@ -104,7 +128,7 @@ namespace usb_asio
         {
             return async_try_blocking_with_ec(
                 executor_,
-                service_->blocking_op_executor(),
+                service_->blocking_op_executor(handle()),
                 std::forward<CompletionToken>(token),
                 [configuration, handle = handle()](auto& ec) {
                     libusb_try(ec, &::libusb_set_configuration, handle, configuration);
@@ -132,7 +156,7 @@ namespace usb_asio
         {
             return async_try_blocking_with_ec(
                 executor_,
-                service_->blocking_op_executor(),
+                service_->blocking_op_executor(handle()),
                 std::forward<CompletionToken>(token),
                 [endpoint, handle = handle()](auto& ec) {
                     libusb_try(ec, &::libusb_clear_halt, handle, endpoint);
@@ -156,28 +180,30 @@ namespace usb_asio
         {
             return async_try_blocking_with_ec(
                 executor_,
-                service_->blocking_op_executor(),
+                service_->blocking_op_executor(handle()),
                 std::forward<CompletionToken>(token),
                 [handle = handle()](auto& ec) {
                     libusb_try(ec, &::libusb_reset_device, handle);
                 });
         }
 
-        void alloc_streams(
+        // Returns the number of streams allocated, which may be less than requested.
+        auto alloc_streams(
             std::uint32_t const num_streams,
-            std::span<std::uint8_t const> const endpoints)
+            std::span<std::uint8_t const> const endpoints) -> std::uint32_t
         {
-            try_with_ec([&](auto& ec) {
-                alloc_streams(num_streams, endpoints, ec);
+            return try_with_ec([&](auto& ec) {
+                return alloc_streams(num_streams, endpoints, ec);
             });
         }
 
-        void alloc_streams(
+        auto alloc_streams(
             std::uint32_t const num_streams,
             std::span<std::uint8_t const> const endpoints,
-            error_code& ec) noexcept
+            error_code& ec) noexcept -> std::uint32_t
         {
-            libusb_try(
+            return libusb_try(
+                ec,
                 &::libusb_alloc_streams,
                 handle(),
                 num_streams,
@@ -199,6 +225,7 @@ namespace usb_asio
             error_code& ec) noexcept
         {
             libusb_try(
+                ec,
                 &::libusb_free_streams,
                 handle(),
                 const_cast<unsigned char*>(
@@ -221,12 +248,25 @@ namespace usb_asio
             return handle_ != nullptr;
         }
 
+        // Statistics of the transfers of this device, see usb_statistics_enabled.
+        // clang-format off
+        [[nodiscard]] auto statistics() const noexcept -> auto const&
+        requires usb_statistics_enabled
+        // clang-format on
+        {
+            return statistics_;
+        }
+
         template <std::convertible_to<executor_type> OtherExecutor>
         auto operator=(basic_usb_device<OtherExecutor>&& other) noexcept -> basic_usb_device&
         {
+            close();
+
             handle_ = std::exchange(other.handle_, nullptr);
+            event_shard_ = other.event_shard_;
             executor_ = other.executor_;
             service_ = other.service_;
+            statistics_ = other.statistics_;
 
             return *this;
         }
@@ -246,8 +286,10 @@ namespace usb_asio
 
       private:
         unique_handle_type handle_;
+        std::size_t event_shard_ = 0;
         executor_type executor_;
         service_type* service_;
+        [[no_unique_address]] detail::usb_device_statistics_ptr statistics_;
     };
 
     using usb_device = basic_usb_device<>;
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_device_info.hpp"
+#include "usb_asio/usb_interface.hpp"
+#include "usb_asio/usb_service.hpp"
+
+namespace usb_asio
+{
+    struct usb_bring_up_options
+    {
+        // Set after opening the device, the active configuration is kept when empty.
+        std::optional<std::uint8_t> configuration = std::nullopt;
+        // The numbers of the interfaces to claim, in order.
+        std::vector<std::uint8_t> interface_numbers = {};
+        bool detach_kernel_drivers = true;
+    };
+
+    // Opens the device, sets its configuration and claims its interfaces, all on the service's
+    // blocking op threads, so that starting a device never blocks the executor.
+    // interfaces[i] claims options.interface_numbers[i]. When a step fails, the interfaces
+    // claimed so far are released and the device is closed again.
+    // Mismatched sizes fail with usb_errc::invalid_param, opening nothing.
+    // The device and the interfaces must not be used until the operation completes.
+    // clang-format off
+    template <
+        typename Executor,
+        std::ranges::random_access_range InterfaceRange,
+        typename CompletionToken = asio::default_completion_token_t<Executor>>
+    auto async_bring_up(
+        basic_usb_device<Executor>& device,
+        usb_device_info const& info,
+        InterfaceRange& interfaces,
+        usb_bring_up_options options,
+        CompletionToken&& token = {})
+    requires std::ranges::sized_range<InterfaceRange>
+    // clang-format on
+    {
+        auto& service = asio::use_service<usb_service>(
+            asio::query(device.get_executor(), asio::execution::context));
+
+        return async_try_blocking_with_ec(
+            device.get_executor(),
+            service.blocking_op_executor(),
+            std::forward<CompletionToken>(token),
+            [&device, &interfaces, info, options = std::move(options)](auto& ec) {
+                auto const num_interfaces = static_cast<std::size_t>(std::ranges::size(interfaces));
+                if (num_interfaces != options.interface_numbers.size())
+                {
+                    ec = make_error_code(usb_errc::invalid_param);
+                    return;
+                }
+
+                device.open(info, ec);
+                if (ec) { return; }
+
+                if (options.configuration)
+                {
+                    device.set_configuration(*options.configuration, ec);
+                }
+
+                auto num_claimed = std::size_t{0};
+                while (!ec && num_claimed < num_interfaces)
+                {
+                    std::ranges::begin(interfaces)[num_claimed].claim(
+                        device,
+                        options.interface_numbers[num_claimed],
+                        options.detach_kernel_drivers,
+                        ec);
+                    if (!ec) { ++num_claimed; }
+                }
+
+                if (ec)
+                {
+                    for (auto index = num_claimed; index-- > 0;)
+                    {
+                        auto unclaim_ec = error_code{};
+                        std::ranges::begin(interfaces)[index].unclaim(unclaim_ec);
+                    }
+                    device.close();
+                }
+            });
+    }
+}  // namespace usb_asio
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <compare>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <optional>
 
@@ -8,6 +10,7 @@
 #include "usb_asio/error.hpp"
 #include "usb_asio/flags.hpp"
 #include "usb_asio/libusb_ptr.hpp"
+#include "usb_asio/usb_descriptor_tree.hpp"
 
 namespace usb_asio
 {
@@ -24,6 +27,8 @@ namespace usb_asio
             ::libusb_config_descriptor,
             &::libusb_free_config_descriptor>;
 
+        usb_device_info() noexcept = default;
+
         explicit usb_device_info(handle_type const handle) noexcept
           : handle_{handle} { }
 
@@ -102,6 +107,23 @@ namespace usb_asio
             return static_cast<usb_speed>(::libusb_get_device_speed(handle()));
         }
 
+        [[nodiscard]] auto max_packet_size(std::uint8_t const endpoint) const
+            -> std::size_t
+        {
+            return try_with_ec([&](auto& ec) {
+                return max_packet_size(endpoint, ec);
+            });
+        }
+
+        [[nodiscard]] auto max_packet_size(
+            std::uint8_t const endpoint,
+            error_code& ec) const noexcept
+            -> std::size_t
+        {
+            return libusb_try(
+                ec, &::libusb_get_max_packet_size, handle(), endpoint);
+        }
+
         [[nodiscard]] auto max_iso_packet_size(std::uint8_t const endpoint) const
             -> std::size_t
         {
@@ -207,9 +229,52 @@ namespace usb_asio
             return config_descriptor_ptr{descriptor};
         }
 
-        friend auto operator<=>(usb_device_info const&, usb_device_info const&) = default;
+        // All descriptors of the device, read once and shared by all infos of the device.
+        // Cheaper than the functions above when descriptors are queried repeatedly.
+        [[nodiscard]] auto descriptors() const -> usb_descriptor_tree const&
+        {
+            return *try_with_ec([&](auto& ec) {
+                return &descriptors(ec);
+            });
+        }
+
+        // Returns an empty tree on error.
+        [[nodiscard]] auto descriptors(error_code& ec) const noexcept -> usb_descriptor_tree const&
+        {
+            ec.clear();
+
+            if (descriptors_ == nullptr)
+            {
+                descriptors_ = detail::usb_descriptor_tree_cache::get(handle(), ec);
+                if (ec) { return empty_descriptors(); }
+            }
+
+            return *descriptors_;
+        }
+
+        [[nodiscard]] friend auto operator<=>(
+            usb_device_info const& lhs,
+            usb_device_info const& rhs) noexcept
+        {
+            return lhs.handle_ <=> rhs.handle_;
+        }
+
+        [[nodiscard]] friend auto operator==(
+            usb_device_info const& lhs,
+            usb_device_info const& rhs) noexcept -> bool
+        {
+            return lhs.handle_ == rhs.handle_;
+        }
 
       private:
         ref_handle_type handle_;
+        // Not synchronized, an info must not be used by several threads at once (copies can)
+        mutable std::shared_ptr<usb_descriptor_tree const> descriptors_;
+
+        [[nodiscard]] static auto empty_descriptors() noexcept -> usb_descriptor_tree const&
+        {
+            static auto const empty = usb_descriptor_tree{};
+            return empty;
+        }
     };
 }  // namespace usb_asio
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/flags.hpp"
+#include "usb_asio/usb_device_info.hpp"
+#include "usb_asio/usb_service.hpp"
+
+namespace usb_asio
+{
+    // Keeps the set of connected devices up to date from libusb hotplug notifications,
+    // instead of enumerating the bus.
+    // Arrivals and departures are queued until waited for (up to max_queued_events each),
+    // each event is delivered to one waiter.
+    class usb_device_registry_service final : public asio::execution_context::service
+    {
+      public:
+        using device_list_type = std::vector<usb_device_info>;
+
+        static inline auto id = asio::execution_context::id{};
+        static constexpr auto max_queued_events = std::size_t{256};
+
+        explicit usb_device_registry_service(asio::execution_context& context)
+          : asio::execution_context::service{context}
+          , usb_service_{&asio::use_service<usb_service>(context)}
+        {
+            if (!::libusb_has_capability(::LIBUSB_CAP_HAS_HOTPLUG))
+            {
+                throw system_error{make_error_code(usb_errc::not_supported)};
+            }
+
+            // Notifications come from libusb event handling
+            usb_service_->retain_event_handling();
+
+            // The devices that are already connected are reported during the registration,
+            // as the initial set rather than as arrivals
+            set_enumerating(true);
+            try
+            {
+                libusb_try(
+                    &::libusb_hotplug_register_callback,
+                    usb_service_->handle(),
+                    static_cast<::libusb_hotplug_event>(
+                        ::LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | ::LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+                    ::LIBUSB_HOTPLUG_ENUMERATE,
+                    LIBUSB_HOTPLUG_MATCH_ANY,
+                    LIBUSB_HOTPLUG_MATCH_ANY,
+                    LIBUSB_HOTPLUG_MATCH_ANY,
+                    &on_hotplug,
+                    this,
+                    &callback_handle_);
+            }
+            catch (...)
+            {
+                usb_service_->release_event_handling();
+                throw;
+            }
+            set_enumerating(false);
+        }
+
+        usb_device_registry_service(usb_device_registry_service const&) = delete;
+
+        usb_device_registry_service(usb_device_registry_service&&) = delete;
+
+        void shutdown() noexcept override
+        {
+            ::libusb_hotplug_deregister_callback(usb_service_->handle(), callback_handle_);
+            usb_service_->release_event_handling();
+
+            auto const lock = std::lock_guard{mutex_};
+            // Handlers are destroyed without being invoked, as the io_context shuts down
+            arrivals_.waiters.clear();
+            departures_.waiters.clear();
+        }
+
+        // The connected devices. Cheap, the list is only rebuilt after a change.
+        [[nodiscard]] auto snapshot() -> std::shared_ptr<device_list_type const>
+        {
+            auto const lock = std::lock_guard{mutex_};
+
+            if (snapshot_ == nullptr)
+            {
+                snapshot_ = std::make_shared<device_list_type const>(devices_);
+            }
+
+            return snapshot_;
+        }
+
+        template <typename Handler>
+        void async_wait(
+            usb_hotplug_event const event,
+            void const* const owner,
+            asio::any_io_executor const& executor,
+            Handler&& handler)
+        {
+            auto const lock = std::lock_guard{mutex_};
+            auto& queue = event_queue_for(event);
+
+            auto& waiter = queue.waiters.emplace_back(owner);
+            waiter.handler.emplace(executor, std::forward<Handler>(handler));
+
+            deliver(queue);
+        }
+
+        // Completes the waits of the owner with asio::error::operation_aborted.
+        void cancel(void const* const owner)
+        {
+            auto const lock = std::lock_guard{mutex_};
+
+            for (auto* const queue : {&arrivals_, &departures_})
+            {
+                std::erase_if(queue->waiters, [&](auto& waiter) {
+                    if (waiter.owner != owner) { return false; }
+
+                    waiter.handler(make_error_code(asio::error::operation_aborted), usb_device_info{});
+                    return true;
+                });
+            }
+        }
+
+        auto operator=(usb_device_registry_service const&) = delete;
+
+        auto operator=(usb_device_registry_service&&) = delete;
+
+      private:
+        struct waiter
+        {
+            void const* owner;
+            detail::completion_handler<asio::any_io_executor, error_code, usb_device_info> handler;
+
+            explicit waiter(void const* const owner) noexcept
+              : owner{owner} { }
+        };
+
+        struct event_queue
+        {
+            std::deque<usb_device_info> events;
+            // Not movable, so not in a deque
+            std::list<waiter> waiters;
+        };
+
+        usb_service* usb_service_;
+        ::libusb_hotplug_callback_handle callback_handle_ = {};
+        bool enumerating_ = false;
+        std::mutex mutex_;
+        device_list_type devices_;
+        std::shared_ptr<device_list_type const> snapshot_;
+        event_queue arrivals_;
+        event_queue departures_;
+
+        void set_enumerating(bool const enumerating)
+        {
+            auto const lock = std::lock_guard{mutex_};
+            enumerating_ = enumerating;
+        }
+
+        [[nodiscard]] auto event_queue_for(usb_hotplug_event const event) noexcept -> event_queue&
+        {
+            return event == usb_hotplug_event::arrived ? arrivals_ : departures_;
+        }
+
+        // Completes as many waiters as there are events, by posting
+        static void deliver(event_queue& queue)
+        {
+            while (!queue.events.empty() && !queue.waiters.empty())
+            {
+                queue.waiters.front().handler(error_code{}, std::move(queue.events.front()));
+                queue.waiters.pop_front();
+                queue.events.pop_front();
+            }
+        }
+
+        void on_event(usb_hotplug_event const event, usb_device_info info)
+        {
+            auto const lock = std::lock_guard{mutex_};
+
+            auto const iter = std::ranges::find(devices_, info);
+            if (event == usb_hotplug_event::arrived)
+            {
+                if (iter != devices_.end()) { return; }
+                devices_.push_back(info);
+            }
+            else
+            {
+                if (iter == devices_.end()) { return; }
+                devices_.erase(iter);
+            }
+            snapshot_.reset();
+
+            if (enumerating_) { return; }
+
+            auto& queue = event_queue_for(event);
+            if (queue.events.size() == max_queued_events)
+            {
+                queue.events.pop_front();
+            }
+            queue.events.push_back(std::move(info));
+
+            deliver(queue);
+        }
+
+        static auto on_hotplug(
+            ::libusb_context* const,
+            ::libusb_device* const device,
+            ::libusb_hotplug_event const event,
+            void* const user_data) noexcept -> int
+        {
+            auto& self = *static_cast<usb_device_registry_service*>(user_data);
+
+            try
+            {
+                self.on_event(static_cast<usb_hotplug_event>(event), usb_device_info{device});
+            }
+            catch (...)
+            {
+                // Nowhere to report it, the event is lost
+            }
+
+            // Stay registered
+            return 0;
+        }
+    };
+
+    // Waits for devices to be connected or disconnected.
+    // All registries of an execution context share the same device set and event queues.
+    template <typename Executor = asio::any_io_executor>
+    class basic_usb_device_registry
+    {
+      public:
+        using executor_type = Executor;
+        using service_type = usb_device_registry_service;
+        using device_list_type = service_type::device_list_type;
+
+        explicit basic_usb_device_registry(executor_type const& executor)
+          : executor_{executor}
+          , service_{&asio::use_service<service_type>(asio::query(executor, asio::execution::context))}
+        {
+        }
+
+        template <std::derived_from<asio::execution_context> ExecutionContext>
+        explicit basic_usb_device_registry(ExecutionContext& context)
+          : basic_usb_device_registry{context.get_executor()}
+        {
+        }
+
+        basic_usb_device_registry(basic_usb_device_registry const&) = delete;
+
+        ~basic_usb_device_registry() noexcept
+        {
+            try
+            {
+                cancel();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        // The connected devices, without enumerating the bus.
+        [[nodiscard]] auto snapshot() const -> std::shared_ptr<device_list_type const>
+        {
+            return service_->snapshot();
+        }
+
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_wait_arrival(CompletionToken&& token = {})
+        {
+            return async_wait_impl(usb_hotplug_event::arrived, token);
+        }
+
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_wait_departure(CompletionToken&& token = {})
+        {
+            return async_wait_impl(usb_hotplug_event::left, token);
+        }
+
+        // Completes the pending waits with asio::error::operation_aborted.
+        void cancel()
+        {
+            service_->cancel(this);
+        }
+
+        auto operator=(basic_usb_device_registry const&) = delete;
+
+      private:
+        executor_type executor_;
+        service_type* service_;
+
+        template <typename CompletionToken>
+        auto async_wait_impl(usb_hotplug_event const event, CompletionToken& token)
+        {
+            return asio::async_initiate<CompletionToken, void(error_code, usb_device_info)>(
+                [](auto completion_handler, auto const event, auto* const self) {
+                    self->service_->async_wait(
+                        event,
+                        self,
+                        self->executor_,
+                        std::move(completion_handler));
+                },
+                token,
+                event,
+                this);
+        }
+    };
+
+    using usb_device_registry = basic_usb_device_registry<>;
+}  // namespace usb_asio
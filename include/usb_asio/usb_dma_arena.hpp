@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+
+#include <libusb.h>
+
+namespace usb_asio
+{
+    struct usb_dma_pool_options
+    {
+        // Size of the DMA arena reserved up front.
+        std::size_t arena_size = std::size_t{4} << 20u;
+        // The arena is carved into slabs of this size, each serving blocks of one size.
+        // It is also the largest block served by the pool, rounded up to a power of 2.
+        std::size_t slab_size = std::size_t{64} << 10u;
+        // Free blocks of one size a thread keeps for itself,
+        // before giving them back to the other threads (concurrent pool only).
+        std::size_t max_cached_blocks = 64;
+    };
+
+    namespace detail
+    {
+        // One DMA arena, reserved up front and carved into slabs of power of 2 blocks.
+        // Slabs are claimed atomically; what happens to the blocks is up to the owner.
+        class usb_dma_arena
+        {
+          public:
+            using device_handle_type = ::libusb_device_handle*;
+
+            // Stored in the free blocks
+            struct free_block
+            {
+                free_block* next;
+            };
+
+            usb_dma_arena(
+                device_handle_type const device_handle,
+                usb_dma_pool_options const& options,
+                std::pmr::memory_resource* const upstream_resource)
+              : device_handle_{device_handle}
+              , upstream_resource_{upstream_resource}
+              , slab_size_{std::bit_ceil(std::max(options.slab_size, min_block_size))}
+              , num_slabs_{(options.arena_size + slab_size_ - 1u) / slab_size_}
+              , slab_classes_{std::make_unique<std::uint8_t[]>(num_slabs_)}
+            {
+                arena_ = static_cast<std::byte*>(static_cast<void*>(
+                    ::libusb_dev_mem_alloc(device_handle_, arena_size())));
+                arena_is_dma_ = arena_ != nullptr;
+
+                if (!arena_is_dma_)
+                {
+                    arena_ = static_cast<std::byte*>(
+                        upstream_resource_->allocate(arena_size(), page_size));
+                }
+            }
+
+            usb_dma_arena(usb_dma_arena const&) = delete;
+
+            ~usb_dma_arena() noexcept
+            {
+                if (arena_is_dma_)
+                {
+                    ::libusb_dev_mem_free(
+                        device_handle_,
+                        static_cast<unsigned char*>(static_cast<void*>(arena_)),
+                        arena_size());
+                }
+                else
+                {
+                    upstream_resource_->deallocate(arena_, arena_size(), page_size);
+                }
+            }
+
+            [[nodiscard]] auto device_handle() const noexcept -> device_handle_type
+            {
+                return device_handle_;
+            }
+
+            [[nodiscard]] auto upstream_resource() const noexcept -> std::pmr::memory_resource*
+            {
+                return upstream_resource_;
+            }
+
+            [[nodiscard]] auto is_dma() const noexcept -> bool
+            {
+                return arena_is_dma_;
+            }
+
+            [[nodiscard]] auto arena_size() const noexcept -> std::size_t
+            {
+                return num_slabs_ * slab_size_;
+            }
+
+            [[nodiscard]] auto num_size_classes() const noexcept -> std::size_t
+            {
+                return static_cast<std::size_t>(std::countr_zero(slab_size_) - min_block_shift + 1);
+            }
+
+            [[nodiscard]] auto owns(void const* const ptr) const noexcept -> bool
+            {
+                auto const address = static_cast<std::byte const*>(ptr);
+                return address >= arena_ && address < arena_ + arena_size();
+            }
+
+            // Whether a block of the arena can serve the request.
+            [[nodiscard]] auto fits(std::size_t const bytes, std::size_t const alignment) const noexcept -> bool
+            {
+                return bytes <= slab_size_ && alignment <= page_size;
+            }
+
+            [[nodiscard]] static auto size_class(
+                std::size_t const bytes,
+                std::size_t const alignment) noexcept -> std::size_t
+            {
+                // Blocks are aligned to their size, up to the page size
+                auto const block_size = std::bit_ceil(std::max({bytes, alignment, min_block_size}));
+                return static_cast<std::size_t>(std::countr_zero(block_size) - min_block_shift);
+            }
+
+            // The size class of a block owned by the arena.
+            [[nodiscard]] auto size_class_of(void const* const ptr) const noexcept -> std::size_t
+            {
+                auto const offset = static_cast<std::size_t>(static_cast<std::byte const*>(ptr) - arena_);
+                return slab_classes_[offset / slab_size_];
+            }
+
+            // Claims a slab for the size class and links its blocks in address order.
+            // Returns nullptr when the arena is used up.
+            [[nodiscard]] auto carve_slab(std::size_t const index, free_block*& tail) noexcept -> free_block*
+            {
+                auto const slab_index = used_slabs_.fetch_add(1, std::memory_order_relaxed);
+                if (slab_index >= num_slabs_)
+                {
+                    used_slabs_.store(num_slabs_, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                // Published to other threads along with the blocks themselves
+                slab_classes_[slab_index] = static_cast<std::uint8_t>(index);
+
+                auto const block_size = min_block_size << index;
+                auto const slab = arena_ + slab_index * slab_size_;
+
+                auto head = static_cast<free_block*>(nullptr);
+                for (auto offset = slab_size_; offset > 0; offset -= block_size)
+                {
+                    head = ::new (slab + offset - block_size) free_block{head};
+                    if (offset == slab_size_) { tail = head; }
+                }
+
+                return head;
+            }
+
+            auto operator=(usb_dma_arena const&) = delete;
+
+          private:
+            static constexpr auto min_block_shift = 6;
+            static constexpr auto min_block_size = std::size_t{1} << min_block_shift;
+            // Alignment of the arena, libusb allocates DMA memory with mmap
+            static constexpr auto page_size = std::size_t{4096};
+
+            device_handle_type device_handle_;
+            std::pmr::memory_resource* upstream_resource_;
+            std::size_t slab_size_;
+            std::size_t num_slabs_;
+            std::unique_ptr<std::uint8_t[]> slab_classes_;
+            std::byte* arena_ = nullptr;
+            bool arena_is_dma_ = false;
+            std::atomic<std::size_t> used_slabs_ = 0;
+        };
+    }  // namespace detail
+}  // namespace usb_asio
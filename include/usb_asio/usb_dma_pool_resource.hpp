@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_dma_arena.hpp"
+
+namespace usb_asio
+{
+    // Serves transfer buffers from one DMA arena, reserved when the pool is created,
+    // with a free list per power of 2 block size.
+    // Both allocation and deallocation are O(1) and never call into libusb.
+    // Larger requests, or requests that do not fit the arena anymore,
+    // go to the upstream resource (which can be a usb_dma_resource).
+    // If the platform does not support DMA memory, the arena is taken from upstream.
+    // Not thread-safe. Must be destroyed before the device is closed.
+    class usb_dma_pool_resource final : public std::pmr::memory_resource
+    {
+      public:
+        using device_handle_type = ::libusb_device_handle*;
+
+        template <typename Executor>
+        explicit usb_dma_pool_resource(basic_usb_device<Executor>& device)
+          : usb_dma_pool_resource{device, usb_dma_pool_options{}} { }
+
+        template <typename Executor>
+        usb_dma_pool_resource(
+            basic_usb_device<Executor>& device,
+            usb_dma_pool_options const& options,
+            std::pmr::memory_resource* const upstream_resource = std::pmr::get_default_resource())
+          : arena_{device.handle(), options, upstream_resource}
+          , free_lists_(arena_.num_size_classes())
+        {
+        }
+
+        usb_dma_pool_resource(usb_dma_pool_resource const&) = delete;
+
+        [[nodiscard]] auto device_handle() const noexcept -> device_handle_type
+        {
+            return arena_.device_handle();
+        }
+
+        [[nodiscard]] auto upstream_resource() const noexcept -> std::pmr::memory_resource*
+        {
+            return arena_.upstream_resource();
+        }
+
+        // False if the platform has no DMA memory, and the arena is ordinary memory.
+        [[nodiscard]] auto is_dma() const noexcept -> bool
+        {
+            return arena_.is_dma();
+        }
+
+        [[nodiscard]] auto owns(void const* const ptr) const noexcept -> bool
+        {
+            return arena_.owns(ptr);
+        }
+
+        auto operator=(usb_dma_pool_resource const&) = delete;
+
+      private:
+        using free_block = detail::usb_dma_arena::free_block;
+
+        detail::usb_dma_arena arena_;
+        std::vector<free_block*> free_lists_;
+
+        [[nodiscard]] auto do_allocate(
+            std::size_t const bytes,
+            std::size_t const alignment) -> void* override
+        {
+            if (arena_.fits(bytes, alignment))
+            {
+                auto const index = arena_.size_class(bytes, alignment);
+                auto& free_list = free_lists_[index];
+
+                if (free_list == nullptr)
+                {
+                    auto tail = static_cast<free_block*>(nullptr);
+                    free_list = arena_.carve_slab(index, tail);
+                }
+
+                if (free_list != nullptr)
+                {
+                    return std::exchange(free_list, free_list->next);
+                }
+            }
+
+            return upstream_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(
+            void* const ptr,
+            std::size_t const bytes,
+            std::size_t const alignment) noexcept override
+        {
+            if (!owns(ptr))
+            {
+                upstream_resource()->deallocate(ptr, bytes, alignment);
+                return;
+            }
+
+            auto& free_list = free_lists_[arena_.size_class_of(ptr)];
+            free_list = ::new (ptr) free_block{free_list};
+        }
+
+        [[nodiscard]] auto do_is_equal(
+            std::pmr::memory_resource const& other) const noexcept
+            -> bool override
+        {
+            return static_cast<std::pmr::memory_resource const*>(this)
+                   == &other;
+        }
+    };
+}  // namespace usb_asio
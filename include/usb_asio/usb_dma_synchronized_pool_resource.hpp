@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_dma_arena.hpp"
+
+namespace usb_asio
+{
+    // Thread-safe variant of usb_dma_pool_resource.
+    // Each thread allocates from its own cache of free blocks, refilled from
+    // the blocks other threads gave back, or by claiming a new slab of the arena.
+    // Freed blocks go to the cache of the freeing thread first, and are given back
+    // to the other threads in batches of max_cached_blocks, by a lock-free push.
+    // The only lock is taken once per thread, when it first uses the resource.
+    // The upstream resource must be thread-safe as well.
+    // Must be destroyed before the device is closed.
+    class usb_dma_synchronized_pool_resource final : public std::pmr::memory_resource
+    {
+      public:
+        using device_handle_type = ::libusb_device_handle*;
+
+        template <typename Executor>
+        explicit usb_dma_synchronized_pool_resource(basic_usb_device<Executor>& device)
+          : usb_dma_synchronized_pool_resource{device, usb_dma_pool_options{}} { }
+
+        template <typename Executor>
+        usb_dma_synchronized_pool_resource(
+            basic_usb_device<Executor>& device,
+            usb_dma_pool_options const& options,
+            std::pmr::memory_resource* const upstream_resource = std::pmr::get_default_resource())
+          : arena_{device.handle(), options, upstream_resource}
+          , max_cached_blocks_{std::max(options.max_cached_blocks, std::size_t{1})}
+          , shared_lists_{std::make_unique<std::atomic<free_block*>[]>(arena_.num_size_classes())}
+        {
+        }
+
+        usb_dma_synchronized_pool_resource(usb_dma_synchronized_pool_resource const&) = delete;
+
+        [[nodiscard]] auto device_handle() const noexcept -> device_handle_type
+        {
+            return arena_.device_handle();
+        }
+
+        [[nodiscard]] auto upstream_resource() const noexcept -> std::pmr::memory_resource*
+        {
+            return arena_.upstream_resource();
+        }
+
+        [[nodiscard]] auto is_dma() const noexcept -> bool
+        {
+            return arena_.is_dma();
+        }
+
+        [[nodiscard]] auto owns(void const* const ptr) const noexcept -> bool
+        {
+            return arena_.owns(ptr);
+        }
+
+        auto operator=(usb_dma_synchronized_pool_resource const&) = delete;
+
+      private:
+        using free_block = detail::usb_dma_arena::free_block;
+
+        struct size_class_cache
+        {
+            // Blocks ready to be allocated
+            free_block* blocks = nullptr;
+            // Blocks freed by this thread, given back in one batch
+            free_block* freed_head = nullptr;
+            free_block* freed_tail = nullptr;
+            std::size_t num_freed = 0;
+        };
+
+        // Only used by the thread that created it
+        struct thread_cache
+        {
+            std::vector<size_class_cache> size_classes;
+        };
+
+        struct thread_cache_entry
+        {
+            std::uint64_t resource_id;
+            thread_cache* cache;
+        };
+
+        static inline auto next_resource_id_ = std::atomic<std::uint64_t>{0};
+
+        detail::usb_dma_arena arena_;
+        std::size_t max_cached_blocks_;
+        // Blocks given back by the threads, only pushed to or taken as a whole,
+        // so there is no ABA problem
+        std::unique_ptr<std::atomic<free_block*>[]> shared_lists_;
+        std::uint64_t resource_id_ = next_resource_id_.fetch_add(1, std::memory_order_relaxed);
+        std::mutex thread_caches_mutex_;
+        std::vector<std::unique_ptr<thread_cache>> thread_caches_;
+
+        [[nodiscard]] auto local_cache() -> thread_cache&
+        {
+            // Ids are never reused, so entries of destroyed resources never match
+            thread_local auto entries = std::vector<thread_cache_entry>{};
+
+            for (auto const& entry : entries)
+            {
+                if (entry.resource_id == resource_id_) { return *entry.cache; }
+            }
+
+            auto cache = std::make_unique<thread_cache>();
+            cache->size_classes.resize(arena_.num_size_classes());
+
+            auto& result = *cache;
+            {
+                auto const lock = std::lock_guard{thread_caches_mutex_};
+                thread_caches_.push_back(std::move(cache));
+            }
+            entries.push_back(thread_cache_entry{resource_id_, &result});
+
+            return result;
+        }
+
+        [[nodiscard]] auto do_allocate(
+            std::size_t const bytes,
+            std::size_t const alignment) -> void* override
+        {
+            if (arena_.fits(bytes, alignment))
+            {
+                auto const index = arena_.size_class(bytes, alignment);
+                auto& cache = local_cache().size_classes[index];
+
+                if (cache.blocks == nullptr && cache.freed_head != nullptr)
+                {
+                    // Reuse own freed blocks first, they are likely still in the CPU cache
+                    cache.blocks = std::exchange(cache.freed_head, nullptr);
+                    cache.freed_tail = nullptr;
+                    cache.num_freed = 0;
+                }
+                if (cache.blocks == nullptr)
+                {
+                    cache.blocks = shared_lists_[index].exchange(nullptr, std::memory_order_acquire);
+                }
+                if (cache.blocks == nullptr)
+                {
+                    auto tail = static_cast<free_block*>(nullptr);
+                    cache.blocks = arena_.carve_slab(index, tail);
+                }
+
+                if (cache.blocks != nullptr)
+                {
+                    return std::exchange(cache.blocks, cache.blocks->next);
+                }
+            }
+
+            return upstream_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(
+            void* const ptr,
+            std::size_t const bytes,
+            std::size_t const alignment) noexcept override
+        {
+            if (!owns(ptr))
+            {
+                upstream_resource()->deallocate(ptr, bytes, alignment);
+                return;
+            }
+
+            auto const index = arena_.size_class_of(ptr);
+            auto* cache = static_cast<size_class_cache*>(nullptr);
+            try
+            {
+                cache = &local_cache().size_classes[index];
+            }
+            catch (...)
+            {
+                // No cache for this thread, give the block back directly
+                push_shared(index, ::new (ptr) free_block{nullptr}, static_cast<free_block*>(ptr));
+                return;
+            }
+
+            cache->freed_head = ::new (ptr) free_block{cache->freed_head};
+            if (cache->freed_tail == nullptr) { cache->freed_tail = cache->freed_head; }
+
+            if (++cache->num_freed >= max_cached_blocks_)
+            {
+                push_shared(
+                    index,
+                    std::exchange(cache->freed_head, nullptr),
+                    std::exchange(cache->freed_tail, nullptr));
+                cache->num_freed = 0;
+            }
+        }
+
+        [[nodiscard]] auto do_is_equal(
+            std::pmr::memory_resource const& other) const noexcept
+            -> bool override
+        {
+            return static_cast<std::pmr::memory_resource const*>(this)
+                   == &other;
+        }
+
+        void push_shared(std::size_t const index, free_block* const head, free_block* const tail) noexcept
+        {
+            auto& shared_list = shared_lists_[index];
+            auto next = shared_list.load(std::memory_order_relaxed);
+            do
+            {
+                tail->next = next;
+            } while (!shared_list.compare_exchange_weak(
+                next,
+                head,
+                std::memory_order_release,
+                std::memory_order_relaxed));
+        }
+    };
+}  // namespace usb_asio
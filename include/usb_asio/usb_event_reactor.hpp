@@ -0,0 +1,258 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+
+#include <libusb.h>
+#include <poll.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/libusb_ptr.hpp"
+
+namespace usb_asio
+{
+    // Handles the events of a libusb context on an io_context,
+    // by watching the libusb file descriptors with the io_context reactor.
+    // Completion callbacks run inline on the io_context threads, serialized by a strand.
+    // The descriptors are watched from start() to pause(), i.e. while a device of the context
+    // is open (see usb_service), whether or not transfers are in flight. The pending waits are
+    // work of the io_context, so io_context::run() does not return while a device is open:
+    // close the devices or stop the io_context to leave it.
+    class usb_event_reactor
+    {
+      public:
+        using handle_type = ::libusb_context*;
+        using executor_type = asio::strand<asio::io_context::executor_type>;
+
+        usb_event_reactor(asio::io_context& context, handle_type const handle)
+          : handle_{handle}
+          , strand_{asio::make_strand(context)}
+          , timeout_timer_{strand_}
+        {
+            ::libusb_set_pollfd_notifiers(
+                handle_,
+                &on_pollfd_added,
+                &on_pollfd_removed,
+                this);
+
+            auto const pollfds = pollfds_ptr{::libusb_get_pollfds(handle_)};
+            if (pollfds == nullptr) { return; }
+
+            for (auto pollfd = pollfds.get(); *pollfd != nullptr; ++pollfd)
+            {
+                on_pollfd_added((*pollfd)->fd, (*pollfd)->events, this);
+            }
+        }
+
+        usb_event_reactor(usb_event_reactor const&) = delete;
+
+        usb_event_reactor(usb_event_reactor&&) = delete;
+
+        ~usb_event_reactor() noexcept
+        {
+            stop();
+        }
+
+        [[nodiscard]] auto handle() const noexcept -> handle_type
+        {
+            return handle_;
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return strand_;
+        }
+
+        // The calls are counted, the descriptors are watched while there were more starts than pauses.
+        // Can be called from any thread.
+        void start()
+        {
+            num_starts_.fetch_add(1, std::memory_order_relaxed);
+            asio::post(strand_, [this]() { reconcile(); });
+        }
+
+        void pause()
+        {
+            num_starts_.fetch_sub(1, std::memory_order_relaxed);
+            asio::post(strand_, [this]() { reconcile(); });
+        }
+
+        // Must be called while no handlers of the io_context run,
+        // e.g. from the shutdown of a service.
+        void stop() noexcept
+        {
+            ::libusb_set_pollfd_notifiers(handle_, nullptr, nullptr, nullptr);
+
+            for (auto& [fd, watch] : watched_fds_)
+            {
+                watch->stop();
+            }
+            watched_fds_.clear();
+
+            auto ec = error_code{};
+            timeout_timer_.cancel(ec);
+        }
+
+        auto operator=(usb_event_reactor const&) = delete;
+
+        auto operator=(usb_event_reactor&&) = delete;
+
+      private:
+        using pollfds_ptr = libusb_ptr<::libusb_pollfd const*, &::libusb_free_pollfds>;
+
+        struct watched_fd
+        {
+            // Of the strand type rather than any_io_executor, which would allocate the
+            // tracked copy of the strand made for each wait
+            asio::posix::basic_stream_descriptor<executor_type> descriptor;
+            short events;
+            bool stopped = false;
+
+            watched_fd(executor_type const& executor, int const fd, short const events)
+              : descriptor{executor, fd}
+              , events{events} { }
+
+            void stop() noexcept
+            {
+                stopped = true;
+                // The descriptor is owned by libusb
+                descriptor.release();
+            }
+        };
+
+        handle_type handle_;
+        executor_type strand_;
+        asio::basic_waitable_timer<
+            std::chrono::steady_clock,
+            asio::wait_traits<std::chrono::steady_clock>,
+            executor_type> timeout_timer_;
+        // Starts minus pauses
+        std::atomic<std::ptrdiff_t> num_starts_ = 0;
+        // Only accessed on the strand
+        std::map<int, std::shared_ptr<watched_fd>> watched_fds_;
+        bool active_ = false;
+        std::size_t generation_ = 0;
+
+        // Watches the descriptors or stops watching them, according to the count as of now rather than
+        // as of the call posting this, since a start and a pause racing on other threads can be posted
+        // in either order
+        void reconcile()
+        {
+            auto const active = num_starts_.load(std::memory_order_relaxed) > 0;
+            if (active == active_) { return; }
+
+            active_ = active;
+            ++generation_;
+
+            if (active_)
+            {
+                for (auto const& [fd, watch] : watched_fds_)
+                {
+                    async_wait(watch);
+                }
+                return;
+            }
+
+            for (auto const& [fd, watch] : watched_fds_)
+            {
+                auto ec = error_code{};
+                watch->descriptor.cancel(ec);
+            }
+
+            auto ec = error_code{};
+            timeout_timer_.cancel(ec);
+        }
+
+        void async_wait(std::shared_ptr<watched_fd> const& watch)
+        {
+            if (watch->events & POLLIN)
+            {
+                async_wait(watch, asio::posix::descriptor_base::wait_read);
+            }
+            if (watch->events & POLLOUT)
+            {
+                async_wait(watch, asio::posix::descriptor_base::wait_write);
+            }
+        }
+
+        void async_wait(
+            std::shared_ptr<watched_fd> const& watch,
+            asio::posix::descriptor_base::wait_type const wait_type)
+        {
+            watch->descriptor.async_wait(
+                wait_type,
+                asio::bind_executor(
+                    strand_,
+                    [this, watch, wait_type, generation = generation_](error_code const& ec) {
+                        if (ec || watch->stopped) { return; }
+
+                        handle_events();
+
+                        // Paused or restarted in the meantime
+                        if (generation != generation_) { return; }
+
+                        async_wait(watch, wait_type);
+                    }));
+        }
+
+        void handle_events() noexcept
+        {
+            auto zero_timeout = ::timeval{};
+            ::libusb_handle_events_timeout_completed(handle_, &zero_timeout, nullptr);
+
+            if (!::libusb_pollfds_handle_timeouts(handle_))
+            {
+                // No timerfd, libusb has to be polled at the next transfer timeout
+                auto next_timeout = ::timeval{};
+                if (::libusb_get_next_timeout(handle_, &next_timeout) == 1)
+                {
+                    timeout_timer_.expires_after(
+                        std::chrono::seconds{next_timeout.tv_sec}
+                        + std::chrono::microseconds{next_timeout.tv_usec});
+                    timeout_timer_.async_wait([this](error_code const& ec) {
+                        if (!ec && active_) { handle_events(); }
+                    });
+                }
+            }
+        }
+
+        static void on_pollfd_added(int const fd, short const events, void* const user_data)
+        {
+            auto& self = *static_cast<usb_event_reactor*>(user_data);
+
+            // Called from inside libusb on any thread
+            asio::post(self.strand_, [&self, fd, events]() {
+                if (auto const iter = self.watched_fds_.find(fd);
+                    iter != self.watched_fds_.end())
+                {
+                    iter->second->stop();
+                    self.watched_fds_.erase(iter);
+                }
+
+                auto const watch = std::make_shared<watched_fd>(self.strand_, fd, events);
+                self.watched_fds_.emplace(fd, watch);
+
+                if (self.active_)
+                {
+                    self.async_wait(watch);
+                }
+            });
+        }
+
+        static void on_pollfd_removed(int const fd, void* const user_data)
+        {
+            auto& self = *static_cast<usb_event_reactor*>(user_data);
+
+            asio::post(self.strand_, [&self, fd]() {
+                if (auto const iter = self.watched_fds_.find(fd);
+                    iter != self.watched_fds_.end())
+                {
+                    iter->second->stop();
+                    self.watched_fds_.erase(iter);
+                }
+            });
+        }
+    };
+}  // namespace usb_asio
@@ -78,7 +78,7 @@ namespace usb_asio
 
         template <std::convertible_to<executor_type> OtherExecutor>
         basic_usb_interface(basic_usb_interface<OtherExecutor>&& other) noexcept
-          : device_handle_{std::exchange(other.device_, nullptr)}
+          : device_handle_{std::exchange(other.device_handle_, nullptr)}
           , number_{std::exchange(other.number_, 0)}
           , executor_{other.executor_}
           , service_{other.service_}
@@ -98,7 +98,7 @@ namespace usb_asio
             bool const detach_kernel_driver = true)
         {
             try_with_ec([&](auto& ec) {
-                claim(device, number, ec);
+                claim(device, number, detach_kernel_driver, ec);
             });
         }
 
@@ -139,6 +139,38 @@ namespace usb_asio
             number_ = number;
         }
 
+        // Detaches the kernel driver and claims the interface on the service's blocking op threads,
+        // after the pending blocking operations of the device.
+        // The interface must not be used until the operation completes.
+        template <
+            typename OtherExecutor,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_claim(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const number,
+            CompletionToken&& token = {})
+        {
+            return async_claim(device, number, true, std::forward<CompletionToken>(token));
+        }
+
+        template <
+            typename OtherExecutor,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_claim(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const number,
+            bool const detach_kernel_driver,
+            CompletionToken&& token = {})
+        {
+            return async_try_blocking_with_ec(
+                executor_,
+                service_->blocking_op_executor(device.handle()),
+                std::forward<CompletionToken>(token),
+                [this, &device, number, detach_kernel_driver](auto& ec) {
+                    claim(device, number, detach_kernel_driver, ec);
+                });
+        }
+
         void unclaim(bool const reattach_kernel_driver = true)
         {
             try_with_ec([&](auto& ec) {
@@ -189,7 +221,7 @@ namespace usb_asio
         {
             return async_try_blocking_with_ec(
                 executor_,
-                service_->blocking_op_executor(),
+                service_->blocking_op_executor(device_handle()),
                 std::forward<CompletionToken>(token),
                 [this, reattach_kernel_driver](auto& ec) {
                     unclaim(reattach_kernel_driver, ec);
@@ -222,7 +254,7 @@ namespace usb_asio
         {
             return async_try_blocking_with_ec(
                 executor_,
-                service_->blocking_op_executor(),
+                service_->blocking_op_executor(device_handle()),
                 std::forward<CompletionToken>(token),
                 [this, alt_setting](auto& ec) {
                     set_alt_setting(alt_setting, ec);
@@ -296,7 +328,7 @@ namespace usb_asio
         }
 
       private:
-        device_handle_type device_handle_;
+        device_handle_type device_handle_ = nullptr;
         std::uint8_t number_ = 0;
         executor_type executor_;
         service_type* service_;
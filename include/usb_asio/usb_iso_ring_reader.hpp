@@ -0,0 +1,349 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    // The packets of one completed transfer of a usb_iso_ring_reader.
+    // The views stay valid until the slot is released.
+    class usb_iso_ring_slot
+    {
+      public:
+        usb_iso_ring_slot() noexcept = default;
+
+        usb_iso_ring_slot(
+            std::size_t const index,
+            std::byte const* const data,
+            std::size_t const packet_size,
+            std::span<usb_iso_packet_transfer_result const> const results) noexcept
+          : index_{index}
+          , data_{data}
+          , packet_size_{packet_size}
+          , results_{results} { }
+
+        // Position of the slot in the ring.
+        [[nodiscard]] auto index() const noexcept -> std::size_t
+        {
+            return index_;
+        }
+
+        [[nodiscard]] auto num_packets() const noexcept -> std::size_t
+        {
+            return results_.size();
+        }
+
+        // The received data of a packet.
+        [[nodiscard]] auto packet(std::size_t const packet_index) const noexcept -> std::span<std::byte const>
+        {
+            return {data_ + packet_index * packet_size_, results_[packet_index].transferred};
+        }
+
+        [[nodiscard]] auto result(std::size_t const packet_index) const noexcept -> usb_iso_packet_transfer_result const&
+        {
+            return results_[packet_index];
+        }
+
+        [[nodiscard]] auto results() const noexcept -> std::span<usb_iso_packet_transfer_result const>
+        {
+            return results_;
+        }
+
+      private:
+        std::size_t index_ = 0;
+        std::byte const* data_ = nullptr;
+        std::size_t packet_size_ = 0;
+        std::span<usb_iso_packet_transfer_result const> results_;
+    };
+
+    // Reads an isochronous IN endpoint continuously, with num_transfers transfers
+    // backed by one ring buffer, allocated from the given memory resource
+    // (e.g. a usb_dma_resource, so that the kernel writes directly into it).
+    // Completed transfers are handed out as slots in submission order, without copying,
+    // and are only resubmitted once the consumer releases them.
+    // Slots do not need to be released in order. The first read starts the streaming.
+    template <typename Executor = asio::any_io_executor>
+    class basic_usb_iso_ring_reader
+    {
+      public:
+        using executor_type = Executor;
+
+        template <typename OtherExecutor>
+        basic_usb_iso_ring_reader(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const num_transfers,
+            std::size_t const packets_per_transfer,
+            std::size_t const packet_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+          : executor_{executor}
+          , ring_{std::make_shared<ring>(
+                executor,
+                device,
+                endpoint,
+                num_transfers,
+                packets_per_transfer,
+                packet_size,
+                mem_resource,
+                timeout)}
+        {
+        }
+
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_iso_ring_reader(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const num_transfers,
+            std::size_t const packets_per_transfer,
+            std::size_t const packet_size,
+            std::pmr::memory_resource* const mem_resource = std::pmr::get_default_resource(),
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+          : basic_usb_iso_ring_reader{
+              device.get_executor(),
+              device,
+              endpoint,
+              num_transfers,
+              packets_per_transfer,
+              packet_size,
+              mem_resource,
+              timeout,
+          }
+        {
+        }
+
+        basic_usb_iso_ring_reader(basic_usb_iso_ring_reader&&) noexcept = default;
+
+        // Slots not released yet become invalid.
+        ~basic_usb_iso_ring_reader() noexcept
+        {
+            if (ring_ != nullptr)
+            {
+                ring_->stop();
+            }
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        [[nodiscard]] auto num_slots() const noexcept -> std::size_t
+        {
+            return ring_->slots.size();
+        }
+
+        // Stops the streaming, pending transfers complete with usb_transfer_errc::cancelled.
+        void cancel()
+        {
+            ring_->stop();
+            // A read waiting for slots held by the consumer would never complete
+            ring_->try_complete_read(usb_completion_dispatch::post);
+        }
+
+        // Waits for the next completed transfer. The slot must be released
+        // (also on error) before it can be used for another transfer.
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_read_packets(CompletionToken&& token = {})
+        {
+            return asio::async_initiate<CompletionToken, void(error_code, usb_iso_ring_slot)>(
+                [](auto completion_handler, ring& ring) {
+                    ring.read(std::move(completion_handler));
+                },
+                token,
+                std::ref(*ring_));
+        }
+
+        // Gives the slot back to the ring, to receive more packets.
+        void release(usb_iso_ring_slot const& slot)
+        {
+            ring_->release(slot.index());
+        }
+
+        auto operator=(basic_usb_iso_ring_reader&&) noexcept -> basic_usb_iso_ring_reader& = default;
+
+      private:
+        using transfer_type = basic_usb_transfer<
+            usb_transfer_type::isochronous,
+            usb_transfer_direction::in,
+            Executor>;
+
+        struct slot
+        {
+            transfer_type transfer;
+            std::byte* data;
+            error_code ec = {};
+            std::span<usb_iso_packet_transfer_result const> results = {};
+            bool in_flight = false;
+        };
+
+        struct ring : std::enable_shared_from_this<ring>
+        {
+            Executor executor;
+            std::pmr::memory_resource* mem_resource;
+            std::size_t packet_size;
+            std::size_t transfer_size;
+            std::byte* buffer;
+            std::vector<slot> slots;
+            // Indices of the submitted slots, in submission order
+            std::vector<std::size_t> order;
+            std::size_t order_head = 0;
+            std::size_t order_size = 0;
+            bool started = false;
+            bool stopped = false;
+            detail::completion_handler<Executor, error_code, usb_iso_ring_slot> pending_read;
+
+            template <typename OtherExecutor>
+            ring(
+                Executor const& executor,
+                basic_usb_device<OtherExecutor>& device,
+                std::uint8_t const endpoint,
+                std::size_t const num_transfers,
+                std::size_t const packets_per_transfer,
+                std::size_t const packet_size,
+                std::pmr::memory_resource* const mem_resource,
+                std::chrono::milliseconds const timeout)
+              : executor{executor}
+              , mem_resource{mem_resource}
+              , packet_size{packet_size}
+              , transfer_size{packets_per_transfer * packet_size}
+              , buffer{static_cast<std::byte*>(
+                    mem_resource->allocate(num_transfers * transfer_size, buffer_alignment))}
+              , order(num_transfers)
+            {
+                try
+                {
+                    slots.reserve(num_transfers);
+                    for (auto index = std::size_t{0}; index < num_transfers; ++index)
+                    {
+                        slots.push_back(slot{
+                            transfer_type{executor, device, endpoint, packets_per_transfer, packet_size, timeout},
+                            buffer + index * transfer_size,
+                        });
+                    }
+                }
+                catch (...)
+                {
+                    mem_resource->deallocate(buffer, num_transfers * transfer_size, buffer_alignment);
+                    throw;
+                }
+            }
+
+            ring(ring const&) = delete;
+
+            ~ring() noexcept
+            {
+                slots.clear();
+                mem_resource->deallocate(buffer, order.size() * transfer_size, buffer_alignment);
+            }
+
+            template <typename Handler>
+            void read(Handler&& handler)
+            {
+                pending_read.emplace(executor, std::forward<Handler>(handler));
+
+                if (!started)
+                {
+                    started = true;
+                    for (auto index = std::size_t{0}; index < slots.size(); ++index)
+                    {
+                        submit(index);
+                    }
+                }
+
+                // Not allowed to complete inline
+                try_complete_read(usb_completion_dispatch::post);
+            }
+
+            void release(std::size_t const index)
+            {
+                if (stopped) { return; }
+
+                submit(index);
+            }
+
+            void stop() noexcept
+            {
+                stopped = true;
+                for (auto& slot : slots)
+                {
+                    if (slot.in_flight)
+                    {
+                        auto ec = error_code{};
+                        slot.transfer.cancel(ec);
+                    }
+                }
+            }
+
+            void submit(std::size_t const index)
+            {
+                auto& slot = slots[index];
+                slot.in_flight = true;
+                order[(order_head + order_size++) % order.size()] = index;
+
+                slot.transfer.async_read_some(
+                    asio::buffer(slot.data, transfer_size),
+                    [self = this->shared_from_this(), index](
+                        error_code const ec,
+                        std::span<usb_iso_packet_transfer_result const> const results) {
+                        auto& slot = self->slots[index];
+                        slot.in_flight = false;
+                        slot.ec = ec;
+                        slot.results = results;
+
+                        self->try_complete_read(usb_completion_dispatch::dispatch);
+                    });
+            }
+
+            void try_complete_read(usb_completion_dispatch const dispatch)
+            {
+                if (!pending_read) { return; }
+
+                if (order_size == 0)
+                {
+                    // Everything is held by the consumer, or the streaming has stopped
+                    if (stopped)
+                    {
+                        pending_read(dispatch, make_error_code(usb_transfer_errc::cancelled), usb_iso_ring_slot{});
+                    }
+                    return;
+                }
+
+                auto const index = order[order_head];
+                auto const& slot = slots[index];
+                if (slot.in_flight) { return; }
+
+                order_head = (order_head + 1) % order.size();
+                --order_size;
+
+                pending_read(
+                    dispatch,
+                    slot.ec,
+                    usb_iso_ring_slot{index, slot.data, packet_size, slot.results});
+            }
+
+            auto operator=(ring const&) = delete;
+        };
+
+        static constexpr auto buffer_alignment = alignof(std::max_align_t);
+
+        executor_type executor_;
+        std::shared_ptr<ring> ring_;
+    };
+
+    using usb_iso_ring_reader = basic_usb_iso_ring_reader<>;
+}  // namespace usb_asio
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include <libusb.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_device_info.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    namespace detail
+    {
+        template <typename Transfer>
+        concept usb_packet_transfer = (Transfer::transfer_type == usb_transfer_type::bulk)
+                                      || (Transfer::transfer_type == usb_transfer_type::interrupt)
+                                      || (Transfer::transfer_type == usb_transfer_type::bulk_stream);
+
+        template <typename Transfer>
+        class usb_read_until_short_packet_op
+        {
+          public:
+            usb_read_until_short_packet_op(
+                Transfer& transfer,
+                asio::mutable_buffer const buffer,
+                std::size_t const max_packet_size) noexcept
+              : transfer_{&transfer}
+              , buffer_{buffer}
+              , max_packet_size_{max_packet_size} { }
+
+            template <typename Self>
+            void operator()(Self& self, error_code ec = {}, std::size_t const transferred = 0)
+            {
+                switch (state_)
+                {
+                    case state::starting:
+                    {
+                        if (max_packet_size_ == 0)
+                        {
+                            state_ = state::invalid_max_packet_size;
+                            asio::post(transfer_->get_executor(), std::move(self));
+                            return;
+                        }
+
+                        auto const aligned_size = buffer_.size() - buffer_.size() % max_packet_size_;
+                        if (buffer_.size() == 0)
+                        {
+                            state_ = state::done;
+                            asio::post(transfer_->get_executor(), std::move(self));
+                        }
+                        else if (aligned_size != 0)
+                        {
+                            state_ = state::reading;
+                            transfer_->async_read_some(asio::buffer(buffer_, aligned_size), std::move(self));
+                        }
+                        else
+                        {
+                            read_last_packet(self);
+                        }
+                        return;
+                    }
+                    case state::reading:
+                    {
+                        transferred_ = transferred;
+                        // A short packet ends the transfer of the device
+                        if (ec || transferred_ != buffer_.size() - buffer_.size() % max_packet_size_
+                            || transferred_ == buffer_.size())
+                        {
+                            break;
+                        }
+                        read_last_packet(self);
+                        return;
+                    }
+                    case state::reading_last_packet:
+                    {
+                        auto const copied = std::min(transferred, buffer_.size() - transferred_);
+                        std::memcpy(static_cast<std::byte*>(buffer_.data()) + transferred_, last_packet_.get(), copied);
+                        transferred_ += copied;
+                        if (!ec && copied < transferred)
+                        {
+                            ec = make_error_code(usb_transfer_errc::overflow);
+                        }
+                        break;
+                    }
+                    case state::done:
+                        break;
+                    case state::invalid_max_packet_size:
+                        ec = make_error_code(usb_errc::invalid_param);
+                        break;
+                }
+
+                last_packet_.reset();
+                self.complete(ec, transferred_);
+            }
+
+          private:
+            enum class state
+            {
+                starting,
+                reading,
+                reading_last_packet,
+                done,
+                invalid_max_packet_size,
+            };
+
+            Transfer* transfer_;
+            asio::mutable_buffer buffer_;
+            std::size_t max_packet_size_;
+            std::size_t transferred_ = 0;
+            state state_ = state::starting;
+            std::unique_ptr<std::byte[]> last_packet_ = nullptr;
+
+            // The remainder of the buffer is shorter than a packet, which the device may fill.
+            // Read a whole packet, so that a longer one is reported as an overflow instead of babble.
+            template <typename Self>
+            void read_last_packet(Self& self)
+            {
+                state_ = state::reading_last_packet;
+                last_packet_ = std::make_unique<std::byte[]>(max_packet_size_);
+                transfer_->async_read_some(asio::buffer(last_packet_.get(), max_packet_size_), std::move(self));
+            }
+        };
+
+        // Whether libusb supports LIBUSB_TRANSFER_ADD_ZERO_PACKET on this platform
+        inline auto usb_zero_packet_flag_supported = std::atomic<bool>{true};
+
+        template <typename Transfer>
+        class usb_write_with_zlp_op
+        {
+          public:
+            usb_write_with_zlp_op(
+                Transfer& transfer,
+                asio::const_buffer const buffer,
+                std::size_t const max_packet_size) noexcept
+              : transfer_{&transfer}
+              , buffer_{buffer}
+              , max_packet_size_{max_packet_size} { }
+
+            template <typename Self>
+            void operator()(Self& self, error_code const ec = {}, std::size_t const transferred = 0)
+            {
+                switch (state_)
+                {
+                    case state::starting:
+                    {
+                        if (max_packet_size_ == 0)
+                        {
+                            state_ = state::invalid_max_packet_size;
+                            asio::post(transfer_->get_executor(), std::move(self));
+                            return;
+                        }
+
+                        if (buffer_.size() == 0 || buffer_.size() % max_packet_size_ != 0)
+                        {
+                            state_ = state::writing;
+                        }
+                        else if (usb_zero_packet_flag_supported.load(std::memory_order_relaxed))
+                        {
+                            // libusb sends the zero length packet, without another submission
+                            state_ = state::writing_flagged;
+                            transfer_->handle()->flags |= ::LIBUSB_TRANSFER_ADD_ZERO_PACKET;
+                        }
+                        else
+                        {
+                            state_ = state::writing_data;
+                        }
+                        transfer_->async_write_some(buffer_, std::move(self));
+                        return;
+                    }
+                    case state::writing_flagged:
+                    {
+                        transfer_->handle()->flags &= static_cast<std::uint8_t>(~::LIBUSB_TRANSFER_ADD_ZERO_PACKET);
+                        if (ec == usb_errc::not_supported)
+                        {
+                            usb_zero_packet_flag_supported.store(false, std::memory_order_relaxed);
+                            state_ = state::writing_data;
+                            transfer_->async_write_some(buffer_, std::move(self));
+                            return;
+                        }
+                        transferred_ = transferred;
+                        break;
+                    }
+                    case state::writing:
+                    {
+                        transferred_ = transferred;
+                        break;
+                    }
+                    case state::writing_data:
+                    {
+                        transferred_ = transferred;
+                        if (ec || transferred_ != buffer_.size())
+                        {
+                            break;
+                        }
+                        state_ = state::writing_zlp;
+                        transfer_->async_write_some(asio::const_buffer{}, std::move(self));
+                        return;
+                    }
+                    case state::writing_zlp:
+                        break;
+                    case state::invalid_max_packet_size:
+                        self.complete(make_error_code(usb_errc::invalid_param), std::size_t{0});
+                        return;
+                }
+
+                self.complete(ec, transferred_);
+            }
+
+          private:
+            enum class state
+            {
+                starting,
+                // A buffer that needs no zero length packet
+                writing,
+                writing_flagged,
+                writing_data,
+                writing_zlp,
+                invalid_max_packet_size,
+            };
+
+            Transfer* transfer_;
+            asio::const_buffer buffer_;
+            std::size_t max_packet_size_;
+            std::size_t transferred_ = 0;
+            state state_ = state::starting;
+        };
+    }  // namespace detail
+
+    // Reads until the buffer is full, or a short packet ends the transfer of the device.
+    // The part of the buffer that is a multiple of max_packet_size is read in place by one transfer.
+    // Only a remainder shorter than a packet is read through a packet sized bounce buffer,
+    // so that a device sending more than fits fails with usb_transfer_errc::overflow
+    // after the data that fit, instead of the packet being lost.
+    // If the device ends a transfer exactly filling the buffer with a zero length packet,
+    // that packet is left to the next read. A max_packet_size of 0 fails with usb_errc::invalid_param.
+    // clang-format off
+    template <
+        detail::usb_packet_transfer Transfer,
+        typename CompletionToken = asio::default_completion_token_t<typename Transfer::executor_type>>
+    auto async_read_until_short_packet(
+        Transfer& transfer,
+        asio::mutable_buffer const buffer,
+        std::size_t const max_packet_size,
+        CompletionToken&& token = {})
+    requires (Transfer::transfer_direction == usb_transfer_direction::in)
+    // clang-format on
+    {
+        return asio::async_compose<CompletionToken, void(error_code, std::size_t)>(
+            detail::usb_read_until_short_packet_op<Transfer>{transfer, buffer, max_packet_size},
+            token,
+            transfer);
+    }
+
+    // clang-format off
+    template <
+        detail::usb_packet_transfer Transfer,
+        typename CompletionToken = asio::default_completion_token_t<typename Transfer::executor_type>>
+    auto async_read_until_short_packet(
+        Transfer& transfer,
+        asio::mutable_buffer const buffer,
+        usb_device_info const& info,
+        CompletionToken&& token = {})
+    requires (Transfer::transfer_direction == usb_transfer_direction::in)
+    // clang-format on
+    {
+        return async_read_until_short_packet(
+            transfer,
+            buffer,
+            info.max_packet_size(transfer.handle()->endpoint),
+            std::forward<CompletionToken>(token));
+    }
+
+    // Writes the buffer as one transfer of the device, ending it with a zero length packet
+    // when its size is a non-zero multiple of max_packet_size. Where libusb supports it
+    // (LIBUSB_TRANSFER_ADD_ZERO_PACKET), the packet is added to the same submission,
+    // otherwise it is submitted after the data. A max_packet_size of 0 fails with usb_errc::invalid_param.
+    // clang-format off
+    template <
+        detail::usb_packet_transfer Transfer,
+        typename CompletionToken = asio::default_completion_token_t<typename Transfer::executor_type>>
+    auto async_write_with_zlp(
+        Transfer& transfer,
+        asio::const_buffer const buffer,
+        std::size_t const max_packet_size,
+        CompletionToken&& token = {})
+    requires (Transfer::transfer_direction == usb_transfer_direction::out)
+    // clang-format on
+    {
+        return asio::async_compose<CompletionToken, void(error_code, std::size_t)>(
+            detail::usb_write_with_zlp_op<Transfer>{transfer, buffer, max_packet_size},
+            token,
+            transfer);
+    }
+
+    // clang-format off
+    template <
+        detail::usb_packet_transfer Transfer,
+        typename CompletionToken = asio::default_completion_token_t<typename Transfer::executor_type>>
+    auto async_write_with_zlp(
+        Transfer& transfer,
+        asio::const_buffer const buffer,
+        usb_device_info const& info,
+        CompletionToken&& token = {})
+    requires (Transfer::transfer_direction == usb_transfer_direction::out)
+    // clang-format on
+    {
+        return async_write_with_zlp(
+            transfer,
+            buffer,
+            info.max_packet_size(transfer.handle()->endpoint),
+            std::forward<CompletionToken>(token));
+    }
+}  // namespace usb_asio
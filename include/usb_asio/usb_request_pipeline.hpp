@@ -0,0 +1,506 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    // A complete response found by the framing function of a usb_request_pipeline
+    struct usb_response_frame
+    {
+        // Correlation id of the request this responds to
+        std::uint64_t correlation_id;
+        // Number of bytes of the response, at the start of the received data
+        std::size_t size;
+    };
+
+    struct usb_request_pipeline_options
+    {
+        // Number of requests written and waiting for their response, further requests are queued.
+        std::size_t window = 8;
+        // Number of IN transfers kept in flight while responses are expected.
+        std::size_t read_depth = 2;
+        // Size of each IN transfer, should be a multiple of the max packet size.
+        std::size_t read_size = 4096;
+        std::chrono::milliseconds write_timeout = usb_no_timeout;
+        // Applies to the transfers of the pipeline, the completion handlers of requests are always posted.
+        usb_completion_dispatch completion_dispatch = usb_completion_dispatch::post;
+        // Memory of the IN transfer buffers, e.g. a usb_dma_resource.
+        std::pmr::memory_resource* mem_resource = std::pmr::get_default_resource();
+    };
+
+    // Pipelines requests to a device over a bulk OUT endpoint, matching them with the responses
+    // received on a bulk IN endpoint, for protocols with a command and a response endpoint.
+    // Up to options.window requests are in flight at a time, each written by a transfer of its own.
+    // The received data is a stream of responses, cut into frames by the framing function,
+    // which returns the correlation id and size of the response at the start of the data,
+    // or std::nullopt while it is incomplete. Responses may arrive in any order.
+    // Responses to no request in flight are dropped.
+    // Like the other I/O objects, the pipeline must not be used concurrently.
+    template <typename Executor = asio::any_io_executor>
+    class basic_usb_request_pipeline
+    {
+      public:
+        using executor_type = Executor;
+        using framing_function = std::function<std::optional<usb_response_frame>(std::span<std::byte const>)>;
+
+        template <typename OtherExecutor>
+        basic_usb_request_pipeline(
+            executor_type const& executor,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const out_endpoint,
+            std::uint8_t const in_endpoint,
+            framing_function framing,
+            usb_request_pipeline_options const& options = {})
+          : executor_{executor}
+          , engine_{std::make_shared<engine>(
+                executor,
+                device,
+                out_endpoint,
+                in_endpoint,
+                std::move(framing),
+                options)}
+        {
+        }
+
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_request_pipeline(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const out_endpoint,
+            std::uint8_t const in_endpoint,
+            framing_function framing,
+            usb_request_pipeline_options const& options = {})
+          : basic_usb_request_pipeline{
+              device.get_executor(),
+              device,
+              out_endpoint,
+              in_endpoint,
+              std::move(framing),
+              options,
+          }
+        {
+        }
+
+        basic_usb_request_pipeline(basic_usb_request_pipeline&&) noexcept = default;
+
+        ~basic_usb_request_pipeline() noexcept
+        {
+            if (engine_ != nullptr)
+            {
+                engine_->cancel();
+            }
+        }
+
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        // Number of requests occupying the window.
+        [[nodiscard]] auto in_flight() const noexcept -> std::size_t
+        {
+            return engine_->in_flight.size();
+        }
+
+        // Number of requests waiting for a place in the window.
+        [[nodiscard]] auto queued() const noexcept -> std::size_t
+        {
+            return engine_->queued.size();
+        }
+
+        // Fails the queued requests and the requests in flight with usb_transfer_errc::cancelled.
+        void cancel()
+        {
+            engine_->cancel();
+        }
+
+        // Writes the request, and completes with the size of its response, copied into the response buffer.
+        // Both buffers must stay valid until then. A response larger than the buffer is truncated,
+        // completing with usb_transfer_errc::overflow. Requests are written in the order they are made,
+        // the correlation id must not be in use by another request of the pipeline.
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_request(
+            std::uint64_t const correlation_id,
+            asio::const_buffer const request,
+            asio::mutable_buffer const response,
+            CompletionToken&& token = {})
+        {
+            return asio::async_initiate<CompletionToken, void(error_code, std::size_t)>(
+                [](auto completion_handler,
+                   engine& engine,
+                   std::uint64_t const correlation_id,
+                   asio::const_buffer const request,
+                   asio::mutable_buffer const response) {
+                    engine.request(correlation_id, request, response, std::move(completion_handler));
+                },
+                token,
+                std::ref(*engine_),
+                correlation_id,
+                request,
+                response);
+        }
+
+        auto operator=(basic_usb_request_pipeline&&) noexcept -> basic_usb_request_pipeline& = default;
+
+      private:
+        using out_transfer_type = basic_usb_transfer<usb_transfer_type::bulk, usb_transfer_direction::out, Executor>;
+        using in_transfer_type = basic_usb_transfer<usb_transfer_type::bulk, usb_transfer_direction::in, Executor>;
+
+        struct request_state
+        {
+            std::uint64_t correlation_id = 0;
+            asio::const_buffer data = {};
+            asio::mutable_buffer response = {};
+            detail::completion_handler<Executor, error_code, std::size_t> handler = {};
+            std::size_t writer = 0;
+            bool is_written = false;
+            bool is_answered = false;
+        };
+
+        using request_list = std::list<request_state>;
+
+        struct reader
+        {
+            in_transfer_type transfer;
+            std::byte* data;
+            error_code ec = {};
+            std::size_t transferred = 0;
+            bool in_flight = false;
+        };
+
+        struct engine : std::enable_shared_from_this<engine>
+        {
+            Executor executor;
+            framing_function framing;
+            usb_request_pipeline_options options;
+            std::byte* buffer;
+            std::vector<out_transfer_type> writers;
+            std::vector<std::size_t> free_writers;
+            std::vector<reader> readers;
+            // The oldest reader in flight
+            std::size_t read_head = 0;
+            std::size_t reads_in_flight = 0;
+            // Received data not framed yet
+            std::vector<std::byte> received;
+            // Requests move between the lists, so that their nodes are reused without allocating
+            request_list queued;
+            request_list in_flight;
+            request_list idle;
+
+            template <typename OtherExecutor>
+            engine(
+                Executor const& executor,
+                basic_usb_device<OtherExecutor>& device,
+                std::uint8_t const out_endpoint,
+                std::uint8_t const in_endpoint,
+                framing_function framing,
+                usb_request_pipeline_options const& options)
+              : executor{executor}
+              , framing{std::move(framing)}
+              , options{fixed_options(options)}
+              , buffer{static_cast<std::byte*>(this->options.mem_resource->allocate(
+                    this->options.read_depth * this->options.read_size,
+                    buffer_alignment))}
+            {
+                try
+                {
+                    writers.reserve(this->options.window);
+                    free_writers.reserve(this->options.window);
+                    for (auto index = std::size_t{0}; index < this->options.window; ++index)
+                    {
+                        auto& writer = writers.emplace_back(executor, device, out_endpoint, this->options.write_timeout);
+                        writer.set_completion_dispatch(this->options.completion_dispatch);
+                        free_writers.push_back(this->options.window - index - 1u);
+                    }
+
+                    readers.reserve(this->options.read_depth);
+                    for (auto index = std::size_t{0}; index < this->options.read_depth; ++index)
+                    {
+                        auto& reader = readers.emplace_back(
+                            in_transfer_type{executor, device, in_endpoint},
+                            buffer + index * this->options.read_size);
+                        reader.transfer.set_completion_dispatch(this->options.completion_dispatch);
+                    }
+                }
+                catch (...)
+                {
+                    this->options.mem_resource->deallocate(
+                        buffer,
+                        this->options.read_depth * this->options.read_size,
+                        buffer_alignment);
+                    throw;
+                }
+            }
+
+            engine(engine const&) = delete;
+
+            ~engine() noexcept
+            {
+                writers.clear();
+                readers.clear();
+                options.mem_resource->deallocate(buffer, options.read_depth * options.read_size, buffer_alignment);
+            }
+
+            template <typename Handler>
+            void request(
+                std::uint64_t const correlation_id,
+                asio::const_buffer const data,
+                asio::mutable_buffer const response,
+                Handler&& handler)
+            {
+                if (find(queued, correlation_id) != queued.end() || find(in_flight, correlation_id) != in_flight.end())
+                {
+                    auto handler_storage = detail::completion_handler<Executor, error_code, std::size_t>{};
+                    handler_storage.emplace(executor, std::forward<Handler>(handler));
+                    handler_storage(make_error_code(usb_errc::invalid_param), 0);
+                    return;
+                }
+
+                if (idle.empty())
+                {
+                    idle.emplace_back();
+                }
+                queued.splice(queued.end(), idle, idle.begin());
+
+                auto& state = queued.back();
+                state.correlation_id = correlation_id;
+                state.data = data;
+                state.response = response;
+                state.is_written = false;
+                state.is_answered = false;
+                state.handler.emplace(executor, std::forward<Handler>(handler));
+
+                write_queued();
+            }
+
+            void cancel() noexcept
+            {
+                for (auto const& state : in_flight)
+                {
+                    if (!state.is_written)
+                    {
+                        auto ec = error_code{};
+                        writers[state.writer].cancel(ec);
+                    }
+                }
+                cancel_reads();
+
+                auto const ec = make_error_code(usb_transfer_errc::cancelled);
+                while (!queued.empty())
+                {
+                    queued.front().handler(ec, 0);
+                    idle.splice(idle.end(), queued, queued.begin());
+                }
+                fail_in_flight(ec);
+            }
+
+            void write_queued()
+            {
+                while (!queued.empty() && !free_writers.empty())
+                {
+                    auto const iter = queued.begin();
+                    in_flight.splice(in_flight.end(), queued, iter);
+                    iter->writer = free_writers.back();
+                    free_writers.pop_back();
+
+                    writers[iter->writer].async_write_some(
+                        iter->data,
+                        [self = this->shared_from_this(), iter](error_code const ec, std::size_t) {
+                            self->on_written(iter, ec);
+                        });
+                }
+
+                read_responses();
+            }
+
+            void on_written(typename request_list::iterator const iter, error_code const ec)
+            {
+                iter->is_written = true;
+                free_writers.push_back(iter->writer);
+
+                if (ec && !iter->is_answered)
+                {
+                    // No response will come
+                    iter->is_answered = true;
+                    iter->handler(ec, 0);
+                }
+                if (iter->is_answered)
+                {
+                    idle.splice(idle.end(), in_flight, iter);
+                }
+
+                write_queued();
+            }
+
+            void read_responses()
+            {
+                if (!expects_responses()) { return; }
+
+                // Readers are submitted round the ring, starting after the oldest one in flight
+                while (reads_in_flight < readers.size())
+                {
+                    submit_read((read_head + reads_in_flight) % readers.size());
+                }
+            }
+
+            void submit_read(std::size_t const index)
+            {
+                auto& reader = readers[index];
+                reader.in_flight = true;
+                ++reads_in_flight;
+
+                reader.transfer.async_read_some(
+                    asio::buffer(reader.data, options.read_size),
+                    [self = this->shared_from_this(), index](error_code const ec, std::size_t const transferred) {
+                        auto& reader = self->readers[index];
+                        reader.in_flight = false;
+                        reader.ec = ec;
+                        reader.transferred = transferred;
+                        self->on_read();
+                    });
+            }
+
+            void on_read()
+            {
+                // IN transfers of an endpoint complete in submission order
+                while (reads_in_flight != 0 && !readers[read_head].in_flight)
+                {
+                    auto& reader = readers[read_head];
+                    read_head = (read_head + 1) % readers.size();
+                    --reads_in_flight;
+
+                    // Reads cancelled while idle keep the data they received
+                    if (reader.ec && reader.ec != usb_transfer_errc::cancelled)
+                    {
+                        // The stream of responses is broken, the requests can no longer be matched
+                        received.clear();
+                        fail_in_flight(reader.ec);
+                        continue;
+                    }
+
+                    received.insert(received.end(), reader.data, reader.data + reader.transferred);
+                    frame_responses();
+                }
+
+                if (expects_responses())
+                {
+                    read_responses();
+                }
+                else
+                {
+                    cancel_reads();
+                }
+            }
+
+            // Reads are only in flight while responses are expected,
+            // so that an idle pipeline does not keep its executor busy.
+            void cancel_reads() noexcept
+            {
+                for (auto& reader : readers)
+                {
+                    if (reader.in_flight)
+                    {
+                        auto ec = error_code{};
+                        reader.transfer.cancel(ec);
+                    }
+                }
+            }
+
+            void frame_responses()
+            {
+                auto framed = std::size_t{0};
+                while (framed < received.size())
+                {
+                    auto const frame = framing(std::span{received}.subspan(framed));
+                    if (!frame || frame->size == 0 || frame->size > received.size() - framed) { break; }
+
+                    auto const iter = find(in_flight, frame->correlation_id);
+                    if (iter != in_flight.end())
+                    {
+                        auto const size = std::min(frame->size, iter->response.size());
+                        std::memcpy(iter->response.data(), received.data() + framed, size);
+                        iter->is_answered = true;
+                        iter->handler(
+                            size < frame->size ? make_error_code(usb_transfer_errc::overflow) : error_code{},
+                            size);
+                        if (iter->is_written)
+                        {
+                            idle.splice(idle.end(), in_flight, iter);
+                        }
+                    }
+
+                    framed += frame->size;
+                }
+
+                received.erase(received.begin(), received.begin() + static_cast<std::ptrdiff_t>(framed));
+            }
+
+            void fail_in_flight(error_code const ec)
+            {
+                for (auto iter = in_flight.begin(); iter != in_flight.end();)
+                {
+                    auto const current = iter++;
+                    if (!current->is_answered)
+                    {
+                        current->is_answered = true;
+                        current->handler(ec, 0);
+                    }
+                    if (current->is_written)
+                    {
+                        idle.splice(idle.end(), in_flight, current);
+                    }
+                }
+            }
+
+            [[nodiscard]] auto expects_responses() const noexcept -> bool
+            {
+                return std::ranges::any_of(in_flight, [](auto const& state) { return !state.is_answered; });
+            }
+
+            // The request with the id that is not answered yet
+            [[nodiscard]] static auto find(request_list& list, std::uint64_t const correlation_id)
+                -> typename request_list::iterator
+            {
+                return std::ranges::find_if(list, [&](auto const& state) {
+                    return state.correlation_id == correlation_id && !state.is_answered;
+                });
+            }
+
+            [[nodiscard]] static auto fixed_options(usb_request_pipeline_options options) noexcept
+                -> usb_request_pipeline_options
+            {
+                options.window = std::max(options.window, std::size_t{1});
+                options.read_depth = std::max(options.read_depth, std::size_t{1});
+                options.read_size = std::max(options.read_size, std::size_t{1});
+                return options;
+            }
+
+            auto operator=(engine const&) = delete;
+        };
+
+        static constexpr auto buffer_alignment = alignof(std::max_align_t);
+
+        executor_type executor_;
+        std::shared_ptr<engine> engine_;
+    };
+
+    using usb_request_pipeline = basic_usb_request_pipeline<>;
+}  // namespace usb_asio
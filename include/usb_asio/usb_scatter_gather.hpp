@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/libusb_ptr.hpp"
+
+namespace usb_asio
+{
+    struct usb_scatter_gather_options
+    {
+        // Buffers of a sequence smaller than this are copied into a staging buffer,
+        // larger ones are transferred in place by a transfer of their own.
+        std::size_t copy_threshold = 4096;
+        // Memory of the staging buffer, e.g. a usb_dma_resource.
+        std::pmr::memory_resource* staging_resource = std::pmr::get_default_resource();
+    };
+
+    namespace detail
+    {
+        // Transfers a buffer sequence as if it was contiguous, for a bulk or interrupt endpoint.
+        // The sequence is split into segments, each transferred by a libusb transfer of its own:
+        // large buffers in place, and runs of small buffers copied into a staging buffer.
+        // Each segment but the last is a multiple of the max packet size, so the device sees
+        // the same packets as for a contiguous buffer. OUT segments are all submitted at once
+        // (the endpoint keeps them in order), IN segments one after another, as a short packet
+        // ends the read.
+        // Completes by invoking the callback of the prototype transfer, with its status
+        // and actual length set to the aggregate result.
+        // Every segment is SHORT_NOT_OK if the prototype is, and the last OUT segment
+        // adds the zero length packet of the prototype (LIBUSB_TRANSFER_ADD_ZERO_PACKET).
+        class usb_scatter_gather
+        {
+          public:
+            using handle_type = ::libusb_transfer*;
+            using unique_handle_type = libusb_ptr<::libusb_transfer, &::libusb_free_transfer>;
+
+            explicit usb_scatter_gather(handle_type const prototype) noexcept
+              : prototype_{prototype} { }
+
+            usb_scatter_gather(usb_scatter_gather const&) = delete;
+
+            ~usb_scatter_gather() noexcept
+            {
+                free_staging();
+            }
+
+            [[nodiscard]] auto options() const noexcept -> usb_scatter_gather_options const&
+            {
+                return options_;
+            }
+
+            void set_options(usb_scatter_gather_options const& options) noexcept
+            {
+                free_staging();
+                options_ = options;
+            }
+
+            // Splits the buffer sequence into segments, copying the staged OUT data.
+            template <typename BufferSequence>
+            void prepare(BufferSequence const& buffers, error_code& ec)
+            {
+                segments_.clear();
+                pieces_.clear();
+                open_segment_ = no_segment;
+                staged_size_ = 0;
+
+                auto const max_packet_size = ::libusb_get_max_packet_size(
+                    ::libusb_get_device(prototype_->dev_handle),
+                    prototype_->endpoint);
+                if (max_packet_size <= 0)
+                {
+                    ec = make_error_code(static_cast<usb_errc>(max_packet_size));
+                    return;
+                }
+                auto const packet_size = static_cast<std::size_t>(max_packet_size);
+
+                auto const end = asio::buffer_sequence_end(buffers);
+                for (auto iter = asio::buffer_sequence_begin(buffers); iter != end; ++iter)
+                {
+                    auto const buffer = asio::const_buffer{*iter};
+                    auto data = static_cast<std::byte*>(const_cast<void*>(buffer.data()));
+                    auto size = buffer.size();
+                    auto const is_last = std::next(iter) == end;
+
+                    if (size < options_.copy_threshold)
+                    {
+                        stage(data, size);
+                        continue;
+                    }
+
+                    // Fill the last packet of the open staged segment, and close it
+                    if (open_segment_ != no_segment)
+                    {
+                        auto const open_size = segments_[open_segment_].size;
+                        auto const fill = std::min(size, (packet_size - open_size % packet_size) % packet_size);
+                        stage(data, fill);
+                        data += fill;
+                        size -= fill;
+                        if (size == 0) { continue; }
+                        open_segment_ = no_segment;
+                    }
+
+                    auto const in_place = is_last ? size : size - size % packet_size;
+                    if (in_place != 0)
+                    {
+                        segments_.push_back(segment{data, in_place, 0, false});
+                    }
+                    stage(data + in_place, size - in_place);
+                }
+
+                if (segments_.empty())
+                {
+                    // An empty sequence, transfer nothing (e.g. a zero length packet)
+                    segments_.push_back(segment{nullptr, 0, 0, false});
+                }
+
+                if (staged_size_ > staging_capacity_)
+                {
+                    free_staging();
+                    staging_ = static_cast<std::byte*>(
+                        options_.staging_resource->allocate(staged_size_, staging_alignment));
+                    staging_capacity_ = staged_size_;
+                }
+
+                for (auto& segment : segments_)
+                {
+                    if (segment.staged)
+                    {
+                        segment.data = staging_ + segment.staging_offset;
+                    }
+                }
+                if (!is_in())
+                {
+                    for (auto const& piece : pieces_)
+                    {
+                        std::memcpy(staging_ + piece.staging_offset, piece.data, piece.size);
+                    }
+                }
+
+                while (transfers_.size() < segments_.size())
+                {
+                    auto handle = unique_handle_type{::libusb_alloc_transfer(0)};
+                    if (handle == nullptr)
+                    {
+                        ec = make_error_code(usb_errc::no_mem);
+                        return;
+                    }
+                    transfers_.push_back(std::move(handle));
+                }
+
+                // Set while nothing is in flight, since cancel() reads them concurrently with
+                // the submission of the next segment from a completion callback
+                auto const short_not_ok = static_cast<std::uint8_t>(
+                    prototype_->flags & ::LIBUSB_TRANSFER_SHORT_NOT_OK);
+                auto const zero_packet = static_cast<std::uint8_t>(
+                    is_in() ? 0 : prototype_->flags & ::LIBUSB_TRANSFER_ADD_ZERO_PACKET);
+                for (auto index = std::size_t{0}; index < transfers_.size(); ++index)
+                {
+                    auto const& transfer = transfers_[index];
+                    transfer->dev_handle = prototype_->dev_handle;
+                    transfer->endpoint = prototype_->endpoint;
+                    transfer->type = prototype_->type;
+                    transfer->flags = index + 1 == segments_.size()
+                                          ? static_cast<std::uint8_t>(short_not_ok | zero_packet)
+                                          : short_not_ok;
+                    transfer->callback = &completion_callback;
+                    transfer->user_data = this;
+                    if (prototype_->type == ::LIBUSB_TRANSFER_TYPE_BULK_STREAM)
+                    {
+                        ::libusb_transfer_set_stream_id(transfer.get(), ::libusb_transfer_get_stream_id(prototype_));
+                    }
+                }
+            }
+
+            // Submits the prepared segments. Nothing is in flight if this fails.
+            void start(error_code& ec) noexcept
+            {
+                completes_inline_ = false;
+                status_ = ::LIBUSB_TRANSFER_COMPLETED;
+                transferred_ = 0;
+                failed_segment_ = segments_.size();
+
+                auto submitted = std::size_t{0};
+                {
+                    // A concurrent cancel() waits for all the segments to be submitted
+                    auto const lock = std::lock_guard{cancel_mutex_};
+                    cancelled_ = false;
+
+                    if (is_in())
+                    {
+                        submit(0, ec);
+                        return;
+                    }
+
+                    // Completions arriving during the submission must not finish the transfer
+                    pending_.store(segments_.size() + 1, std::memory_order_relaxed);
+
+                    for (; submitted < segments_.size(); ++submitted)
+                    {
+                        auto submit_ec = error_code{};
+                        submit(submitted, submit_ec);
+                        if (submit_ec)
+                        {
+                            if (submitted == 0)
+                            {
+                                ec = submit_ec;
+                                return;
+                            }
+                            failed_segment_ = submitted;
+                            status_ = submit_ec == usb_errc::no_device
+                                          ? ::LIBUSB_TRANSFER_NO_DEVICE
+                                          : ::LIBUSB_TRANSFER_ERROR;
+                            break;
+                        }
+                    }
+                }
+
+                // Unlocked, as completing disarms the deadline, whose expiry cancels with the wheel locked
+                release(segments_.size() - submitted + 1, true);
+            }
+
+            void cancel() noexcept
+            {
+                auto const lock = std::lock_guard{cancel_mutex_};
+                cancelled_ = true;
+                for (auto index = std::size_t{0}; index < segments_.size(); ++index)
+                {
+                    ::libusb_cancel_transfer(transfers_[index].get());
+                }
+            }
+
+            // Whether the completion being delivered was reached from start(), on the initiating thread,
+            // so that the prototype's callback must not invoke the handler inline.
+            [[nodiscard]] auto completes_inline() const noexcept -> bool
+            {
+                return completes_inline_;
+            }
+
+            auto operator=(usb_scatter_gather const&) = delete;
+
+          private:
+            static constexpr auto staging_alignment = alignof(std::max_align_t);
+            static constexpr auto no_segment = static_cast<std::size_t>(-1);
+
+            struct segment
+            {
+                std::byte* data;
+                std::size_t size;
+                std::size_t staging_offset;
+                bool staged;
+                std::size_t transferred = 0;
+                ::libusb_transfer_status status = ::LIBUSB_TRANSFER_COMPLETED;
+            };
+
+            // A staged part of a user buffer
+            struct piece
+            {
+                std::byte* data;
+                std::size_t size;
+                std::size_t staging_offset;
+            };
+
+            handle_type prototype_;
+            usb_scatter_gather_options options_;
+            std::vector<unique_handle_type> transfers_;
+            std::vector<segment> segments_;
+            std::vector<piece> pieces_;
+            std::size_t open_segment_ = no_segment;
+            std::size_t staged_size_ = 0;
+            std::byte* staging_ = nullptr;
+            std::size_t staging_capacity_ = 0;
+            std::atomic<std::size_t> pending_ = 0;
+            // Serializes cancel() with the submission of the next IN segment, which it would miss otherwise
+            std::mutex cancel_mutex_;
+            bool cancelled_ = false;
+            bool completes_inline_ = false;
+            ::libusb_transfer_status status_ = ::LIBUSB_TRANSFER_COMPLETED;
+            std::size_t transferred_ = 0;
+            std::size_t failed_segment_ = 0;
+
+            [[nodiscard]] auto is_in() const noexcept -> bool
+            {
+                return (prototype_->endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+            }
+
+            void stage(std::byte* const data, std::size_t const size)
+            {
+                if (size == 0) { return; }
+
+                if (open_segment_ == no_segment)
+                {
+                    open_segment_ = segments_.size();
+                    segments_.push_back(segment{nullptr, 0, staged_size_, true});
+                }
+                pieces_.push_back(piece{data, size, staged_size_});
+                segments_[open_segment_].size += size;
+                staged_size_ += size;
+            }
+
+            void submit(std::size_t const index, error_code& ec) noexcept
+            {
+                auto const& segment = segments_[index];
+                auto const handle = transfers_[index].get();
+                handle->timeout = prototype_->timeout;
+                handle->buffer = reinterpret_cast<unsigned char*>(segment.data);
+                handle->length = static_cast<int>(segment.size);
+
+                libusb_try(ec, &::libusb_submit_transfer, handle);
+            }
+
+            static void completion_callback(handle_type const handle) noexcept
+            {
+                auto& self = *static_cast<usb_scatter_gather*>(handle->user_data);
+                auto const index = static_cast<std::size_t>(
+                    std::ranges::find(self.transfers_, handle, &unique_handle_type::get)
+                    - self.transfers_.begin());
+
+                auto& segment = self.segments_[index];
+                segment.transferred = static_cast<std::size_t>(handle->actual_length);
+                segment.status = handle->status;
+
+                if (!self.is_in())
+                {
+                    self.release(1, false);
+                    return;
+                }
+
+                self.copy_out(segment);
+                self.transferred_ += segment.transferred;
+
+                auto const is_complete = segment.status != ::LIBUSB_TRANSFER_COMPLETED
+                                         || segment.transferred < segment.size
+                                         || index + 1 == self.segments_.size();
+                if (is_complete)
+                {
+                    self.status_ = segment.status;
+                }
+                else
+                {
+                    // The next segment completes on this event handling thread, after this callback
+                    auto const lock = std::lock_guard{self.cancel_mutex_};
+                    if (self.cancelled_)
+                    {
+                        self.status_ = ::LIBUSB_TRANSFER_CANCELLED;
+                    }
+                    else
+                    {
+                        auto ec = error_code{};
+                        self.submit(index + 1, ec);
+                        if (!ec) { return; }
+                        self.status_ = ec == usb_errc::no_device ? ::LIBUSB_TRANSFER_NO_DEVICE : ::LIBUSB_TRANSFER_ERROR;
+                    }
+                }
+
+                self.completes_inline_ = false;
+                self.complete();
+            }
+
+            void copy_out(segment const& segment) noexcept
+            {
+                if (!segment.staged) { return; }
+
+                auto const end = segment.staging_offset + segment.transferred;
+                auto const first = std::ranges::lower_bound(
+                    pieces_,
+                    segment.staging_offset,
+                    {},
+                    &piece::staging_offset);
+                for (auto iter = first; iter != pieces_.end() && iter->staging_offset < end; ++iter)
+                {
+                    std::memcpy(
+                        iter->data,
+                        staging_ + iter->staging_offset,
+                        std::min(iter->size, end - iter->staging_offset));
+                }
+            }
+
+            void release(std::size_t const count, bool const from_start) noexcept
+            {
+                if (pending_.fetch_sub(count, std::memory_order_acq_rel) != count) { return; }
+                completes_inline_ = from_start;
+
+                // The data reached the device up to the first incomplete segment
+                auto const submission_status = status_;
+                status_ = ::LIBUSB_TRANSFER_COMPLETED;
+                for (auto index = std::size_t{0}; index < segments_.size(); ++index)
+                {
+                    if (index == failed_segment_)
+                    {
+                        status_ = submission_status;
+                        break;
+                    }
+
+                    auto const& segment = segments_[index];
+                    transferred_ += segment.transferred;
+                    if (segment.status != ::LIBUSB_TRANSFER_COMPLETED)
+                    {
+                        status_ = segment.status;
+                        break;
+                    }
+                    if (segment.transferred < segment.size) { break; }
+                }
+
+                complete();
+            }
+
+            void complete() noexcept
+            {
+                prototype_->status = status_;
+                prototype_->actual_length = static_cast<int>(transferred_);
+                prototype_->callback(prototype_);
+            }
+
+            void free_staging() noexcept
+            {
+                if (staging_ != nullptr)
+                {
+                    options_.staging_resource->deallocate(
+                        std::exchange(staging_, nullptr),
+                        staging_capacity_,
+                        staging_alignment);
+                    staging_capacity_ = 0;
+                }
+            }
+        };
+    }  // namespace detail
+}  // namespace usb_asio
@@ -1,36 +1,77 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <span>
 #include <thread>
+#include <vector>
 
 #include <libusb.h>
 #include "usb_asio/asio.hpp"
 #include "usb_asio/error.hpp"
 #include "usb_asio/libusb_ptr.hpp"
+#include "usb_asio/usb_deadline.hpp"
+#include "usb_asio/usb_device_info.hpp"
+#include "usb_asio/usb_event_reactor.hpp"
 
 namespace usb_asio
 {
+    struct usb_service_options
+    {
+        // When set, the libusb file descriptors are watched by this io_context
+        // (usually the one owning the service), and events are handled inline
+        // on its threads instead of on dedicated event threads.
+        // This saves a thread hop per completion. The io_context then does not
+        // run out of work while a device is open (see usb_event_reactor).
+        asio::io_context* event_reactor = nullptr;
+        // Number of libusb contexts, each with its own event thread.
+        // libusb serializes event handling within a context, so completions
+        // of many busy devices only scale when devices are spread over contexts.
+        // Opened devices are assigned to the least loaded context.
+        std::size_t event_shards = 1;
+        // Number of threads running the blocking operations (set_configuration, clear_halt,
+        // reset_device, unclaim, set_alt_setting). Operations on the same device handle
+        // run in submission order, operations on different devices run in parallel.
+        std::size_t blocking_op_threads = 1;
+        // Tick of the timer wheel expiring the deadlines of transfer operations (see with_deadline).
+        // Deadlines expire up to this late, and the wheel wakes up this often while deadlines are pending.
+        std::chrono::nanoseconds deadline_resolution = std::chrono::milliseconds{1};
+    };
+
     class usb_service final : public asio::execution_context::service
     {
       public:
         using handle_type = ::libusb_context*;
         using unique_handle_type = libusb_ptr<::libusb_context, &::libusb_exit>;
+        using device_handle_type = ::libusb_device_handle*;
 
         static inline auto id = asio::execution_context::id{};
 
         explicit usb_service(asio::execution_context& context)
+          : usb_service{context, usb_service_options{}}
+        {
+        }
+
+        usb_service(
+            asio::execution_context& context,
+            usb_service_options const& options)
           : asio::execution_context::service{context}
-          , handle_{create()}
-          , usb_event_thread_{[this](auto const& stop_token) {
-              run_usb_event_thread(stop_token);
-          }}
-          , blocking_op_thread_{[this]() { blocking_op_ioc_.run(); }}
+          , shards_{create_shards(options)}
+          , deadline_resolution_{options.deadline_resolution}
           , blocking_op_executor_{
                 asio::require(
                     blocking_op_ioc_.get_executor(),
                     asio::execution::outstanding_work_t::tracked),
             }
+          , blocking_op_strands_{create_blocking_op_strands(blocking_op_ioc_)}
+          , blocking_op_threads_{create_blocking_op_threads(blocking_op_ioc_, options)}
         {
         }
 
@@ -38,15 +79,29 @@ namespace usb_asio
 
         usb_service(usb_service&&) = delete;
 
+        ~usb_service() noexcept override
+        {
+            // Let the blocking op threads exit once the pending operations are done
+            blocking_op_executor_ = asio::any_io_executor{};
+        }
+
         void shutdown() noexcept override
         {
-            usb_event_thread_.request_stop();
-            usb_event_loop_cv_.notify_one();
+            for (auto& shard : shards_)
+            {
+                shard->stop();
+            }
         }
 
+        // The context used for enumeration.
         [[nodiscard]] auto handle() const noexcept -> handle_type
         {
-            return handle_.get();
+            return shards_.front()->handle();
+        }
+
+        [[nodiscard]] auto num_event_shards() const noexcept -> std::size_t
+        {
+            return shards_.size();
         }
 
         [[nodiscard]] auto blocking_op_executor() noexcept
@@ -54,19 +109,73 @@ namespace usb_asio
             return blocking_op_executor_;
         }
 
-        void notify_dev_opened()
+        // Runs the blocking operations of a device in order, on one of the blocking op threads.
+        // Devices share a strand with the others hashed to it.
+        [[nodiscard]] auto blocking_op_executor(device_handle_type const device_handle) noexcept
         {
-            auto lock = std::unique_lock{usb_event_loop_mutex_};
-            if (open_devices_.fetch_add(1) == 0)
+            // Fibonacci hashing, the low bits of the pointers are all zero
+            auto const hash = reinterpret_cast<std::uintptr_t>(device_handle) * std::uintptr_t{11400714819323198485ull};
+            return blocking_op_strands_[hash >> (sizeof(std::uintptr_t) * 8 - blocking_op_strand_bits)];
+        }
+
+        // Expires the deadlines of transfer operations, created with its thread on first use.
+        [[nodiscard]] auto timer_wheel() -> detail::usb_timer_wheel&
+        {
+            std::call_once(timer_wheel_created_, [this]() {
+                timer_wheel_.emplace(deadline_resolution_);
+            });
+            return *timer_wheel_;
+        }
+
+        // Opens the device in the least loaded event shard.
+        // Returns the device handle and the shard index to pass to close_device.
+        [[nodiscard]] auto open_device(
+            usb_device_info const& info,
+            std::size_t& shard_index,
+            error_code& ec) -> device_handle_type
+        {
+            shard_index = static_cast<std::size_t>(
+                std::ranges::min_element(shards_, {}, [](auto const& shard) {
+                    return shard->open_devices();
+                })
+                - shards_.begin());
+            auto& shard = *shards_[shard_index];
+
+            auto device_handle = device_handle_type{};
+            if (shard_index == 0)
             {
-                lock.unlock();
-                usb_event_loop_cv_.notify_one();
+                libusb_try(ec, &::libusb_open, info.handle(), &device_handle);
+            }
+            else
+            {
+                device_handle = shard.open_same_device(info, ec);
             }
+            if (ec) { return nullptr; }
+
+            shard.notify_dev_opened();
+
+            return device_handle;
+        }
+
+        void close_device(
+            device_handle_type const device_handle,
+            std::size_t const shard_index) noexcept
+        {
+            // Closing cancels pending transfers, which still need the event thread.
+            ::libusb_close(device_handle);
+            shards_[shard_index]->notify_dev_closed();
         }
 
-        void notify_dev_closed() noexcept
+        // Keeps the events of the enumeration context handled while no device is open,
+        // e.g. for hotplug notifications.
+        void retain_event_handling()
         {
-            --open_devices_;
+            shards_.front()->notify_dev_opened();
+        }
+
+        void release_event_handling() noexcept
+        {
+            shards_.front()->notify_dev_closed();
         }
 
         auto operator=(usb_service const&) = delete;
@@ -79,40 +188,224 @@ namespace usb_asio
         }
 
       private:
-        unique_handle_type handle_;
-        std::atomic<std::size_t> open_devices_ = 0;
-        std::mutex usb_event_loop_mutex_;
-        std::condition_variable usb_event_loop_cv_;
-        std::jthread usb_event_thread_;
-        asio::io_context blocking_op_ioc_;
-        std::jthread blocking_op_thread_;
-        asio::any_io_executor blocking_op_executor_;
-
-        void run_usb_event_thread(std::stop_token const& stop_token) noexcept
+        class event_shard
         {
-            while (true)
+          public:
+            event_shard()
+              : handle_{create()}
+              , usb_event_thread_{[this](auto const& stop_token) {
+                  run_usb_event_thread(stop_token);
+              }}
+            {
+            }
+
+            explicit event_shard(asio::io_context& reactor_context)
+              : handle_{create()}
+            {
+                reactor_.emplace(reactor_context, handle());
+            }
+
+            event_shard(event_shard const&) = delete;
+
+            event_shard(event_shard&&) = delete;
+
+            ~event_shard() noexcept
+            {
+                stop();
+            }
+
+            [[nodiscard]] auto handle() const noexcept -> handle_type
+            {
+                return handle_.get();
+            }
+
+            [[nodiscard]] auto open_devices() const noexcept -> std::size_t
+            {
+                return open_devices_;
+            }
+
+            void stop() noexcept
+            {
+                if (reactor_)
+                {
+                    reactor_->stop();
+                    return;
+                }
+
+                usb_event_thread_.request_stop();
+                {
+                    // Do not miss a waiter that is about to block
+                    auto const lock = std::lock_guard{usb_event_loop_mutex_};
+                }
+                usb_event_loop_cv_.notify_one();
+                ::libusb_interrupt_event_handler(handle());
+            }
+
+            void notify_dev_opened()
             {
+                if (reactor_)
                 {
-                    auto lock = std::unique_lock{usb_event_loop_mutex_};
-                    usb_event_loop_cv_.wait(lock, [&]() {
-                        return open_devices_ > 0 || stop_token.stop_requested();
-                    });
+                    ++open_devices_;
+                    reactor_->start();
+                    return;
                 }
 
-                if (stop_token.stop_requested())
+                auto lock = std::unique_lock{usb_event_loop_mutex_};
+                if (open_devices_.fetch_add(1) == 0)
+                {
+                    lock.unlock();
+                    usb_event_loop_cv_.notify_one();
+                }
+            }
+
+            void notify_dev_closed() noexcept
+            {
+                --open_devices_;
+                if (reactor_)
+                {
+                    reactor_->pause();
+                }
+            }
+
+            // A device info belongs to the context it was enumerated from,
+            // find the same physical device in this context.
+            [[nodiscard]] auto open_same_device(
+                usb_device_info const& info,
+                error_code& ec) -> device_handle_type
+            {
+                auto device_handles = static_cast<usb_device_info::handle_type*>(nullptr);
+                auto const num_devices = libusb_try(
+                    ec,
+                    &::libusb_get_device_list,
+                    handle(),
+                    &device_handles);
+                if (ec) { return nullptr; }
+
+                auto handles_deleter = [](auto const device_handles) {
+                    ::libusb_free_device_list(device_handles, true);
+                };
+                auto handles_owner = std::unique_ptr<usb_device_info::handle_type[], decltype(handles_deleter)>{
+                    device_handles,
+                    handles_deleter,
+                };
+
+                auto const devices = std::span{device_handles, num_devices};
+                auto const iter = std::ranges::find_if(devices, [&](auto const device) {
+                    return ::libusb_get_bus_number(device) == info.bus_number()
+                           && ::libusb_get_device_address(device) == info.device_address();
+                });
+                if (iter == devices.end())
+                {
+                    ec = make_error_code(usb_errc::no_device);
+                    return nullptr;
+                }
+
+                auto device_handle = device_handle_type{};
+                libusb_try(ec, &::libusb_open, *iter, &device_handle);
+                return device_handle;
+            }
+
+            auto operator=(event_shard const&) = delete;
+
+            auto operator=(event_shard&&) = delete;
+
+          private:
+            unique_handle_type handle_;
+            std::atomic<std::size_t> open_devices_ = 0;
+            std::mutex usb_event_loop_mutex_;
+            std::condition_variable usb_event_loop_cv_;
+            std::jthread usb_event_thread_;
+            std::optional<usb_event_reactor> reactor_;
+
+            void run_usb_event_thread(std::stop_token const& stop_token) noexcept
+            {
+                while (true)
                 {
-                    break;
+                    {
+                        auto lock = std::unique_lock{usb_event_loop_mutex_};
+                        usb_event_loop_cv_.wait(lock, [&]() {
+                            return open_devices_ > 0 || stop_token.stop_requested();
+                        });
+                    }
+
+                    if (stop_token.stop_requested())
+                    {
+                        break;
+                    }
+
+                    ::libusb_handle_events(handle());
                 }
+            }
 
-                ::libusb_handle_events(handle());
+            [[nodiscard]] static auto create() -> unique_handle_type
+            {
+                auto handle = handle_type{};
+                libusb_try(&::libusb_init, &handle);
+                return unique_handle_type{handle};
             }
+        };
+
+        using blocking_op_strand_type = asio::strand<asio::io_context::executor_type>;
+
+        static constexpr auto blocking_op_strand_bits = std::size_t{6};
+
+        std::vector<std::unique_ptr<event_shard>> shards_;
+        std::chrono::nanoseconds deadline_resolution_;
+        std::once_flag timer_wheel_created_;
+        std::optional<detail::usb_timer_wheel> timer_wheel_;
+        asio::io_context blocking_op_ioc_;
+        asio::any_io_executor blocking_op_executor_;
+        std::vector<blocking_op_strand_type> blocking_op_strands_;
+        std::vector<std::jthread> blocking_op_threads_;
+
+        [[nodiscard]] static auto create_blocking_op_strands(asio::io_context& blocking_op_ioc)
+            -> std::vector<blocking_op_strand_type>
+        {
+            auto constexpr num_strands = std::size_t{1} << blocking_op_strand_bits;
+
+            auto strands = std::vector<blocking_op_strand_type>{};
+            strands.reserve(num_strands);
+            while (strands.size() < num_strands)
+            {
+                strands.push_back(asio::make_strand(blocking_op_ioc.get_executor()));
+            }
+
+            return strands;
+        }
+
+        [[nodiscard]] static auto create_blocking_op_threads(
+            asio::io_context& blocking_op_ioc,
+            usb_service_options const& options)
+            -> std::vector<std::jthread>
+        {
+            auto threads = std::vector<std::jthread>{};
+            threads.reserve(std::max(options.blocking_op_threads, std::size_t{1}));
+            do
+            {
+                threads.emplace_back([&blocking_op_ioc]() { blocking_op_ioc.run(); });
+            } while (threads.size() < options.blocking_op_threads);
+
+            return threads;
         }
 
-        [[nodiscard]] static auto create() -> unique_handle_type
+        [[nodiscard]] static auto create_shards(usb_service_options const& options)
+            -> std::vector<std::unique_ptr<event_shard>>
         {
-            auto handle = handle_type{};
-            libusb_try(&::libusb_init, &handle);
-            return unique_handle_type{handle};
+            auto shards = std::vector<std::unique_ptr<event_shard>>{};
+            shards.reserve(std::max(options.event_shards, std::size_t{1}));
+            do
+            {
+                if (options.event_reactor != nullptr)
+                {
+                    shards.push_back(std::make_unique<event_shard>(*options.event_reactor));
+                }
+                else
+                {
+                    shards.push_back(std::make_unique<event_shard>());
+                }
+            } while (shards.size() < options.event_shards);
+
+            return shards;
         }
     };
 }  // namespace usb_asio
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/asio.hpp"
+#include "usb_asio/error.hpp"
+
+namespace usb_asio
+{
+    // Per-endpoint transfer statistics are only recorded when USB_ASIO_ENABLE_STATISTICS is defined,
+    // otherwise the instrumentation compiles to nothing.
+#ifdef USB_ASIO_ENABLE_STATISTICS
+    inline constexpr auto usb_statistics_enabled = true;
+#else
+    inline constexpr auto usb_statistics_enabled = false;
+#endif
+
+    class usb_latency_histogram_snapshot
+    {
+      public:
+        // Bucket i counts the durations in [2^i, 2^(i+1)) ns, the first one also counts 0,
+        // and the last one everything above.
+        static constexpr auto num_buckets = std::size_t{40};
+
+        using buckets_type = std::array<std::uint64_t, num_buckets>;
+
+        usb_latency_histogram_snapshot() noexcept = default;
+
+        explicit usb_latency_histogram_snapshot(buckets_type const& buckets) noexcept
+          : buckets_{buckets} { }
+
+        [[nodiscard]] auto buckets() const noexcept -> buckets_type const&
+        {
+            return buckets_;
+        }
+
+        [[nodiscard]] auto count() const noexcept -> std::uint64_t
+        {
+            auto count = std::uint64_t{0};
+            for (auto const bucket : buckets_)
+            {
+                count += bucket;
+            }
+            return count;
+        }
+
+        // Upper bound of the bucket holding the given fraction of the durations, e.g. 0.99.
+        [[nodiscard]] auto percentile(double const fraction) const noexcept -> std::chrono::nanoseconds
+        {
+            auto const rank = static_cast<std::uint64_t>(fraction * static_cast<double>(count()));
+            auto seen = std::uint64_t{0};
+            for (auto index = std::size_t{0}; index < num_buckets; ++index)
+            {
+                seen += buckets_[index];
+                if (seen > rank || (seen == rank && rank != 0 && seen == count()))
+                {
+                    return std::chrono::nanoseconds{std::int64_t{2} << index};
+                }
+            }
+
+            return std::chrono::nanoseconds{0};
+        }
+
+      private:
+        buckets_type buckets_ = {};
+    };
+
+    class usb_latency_histogram
+    {
+      public:
+        static constexpr auto num_buckets = usb_latency_histogram_snapshot::num_buckets;
+
+        void record(std::chrono::nanoseconds const duration) noexcept
+        {
+            auto const ns = static_cast<std::uint64_t>(std::max(duration.count(), std::int64_t{1}));
+            auto const index = std::min(
+                static_cast<std::size_t>(std::bit_width(ns) - 1),
+                num_buckets - 1u);
+            buckets_[index].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] auto snapshot() const noexcept -> usb_latency_histogram_snapshot
+        {
+            auto buckets = usb_latency_histogram_snapshot::buckets_type{};
+            for (auto index = std::size_t{0}; index < num_buckets; ++index)
+            {
+                buckets[index] = buckets_[index].load(std::memory_order_relaxed);
+            }
+            return usb_latency_histogram_snapshot{buckets};
+        }
+
+      private:
+        std::array<std::atomic<std::uint64_t>, num_buckets> buckets_ = {};
+    };
+
+    struct usb_endpoint_statistics_snapshot
+    {
+        // Transfer statuses, indexed by LIBUSB_TRANSFER_* value.
+        static constexpr auto num_statuses = std::size_t{::LIBUSB_TRANSFER_OVERFLOW + 1};
+
+        std::uint8_t endpoint = 0;
+        std::uint64_t submitted = 0;
+        // Submissions rejected by libusb, which never complete.
+        std::uint64_t submit_errors = 0;
+        std::uint64_t completed = 0;
+        std::uint64_t bytes = 0;
+        std::array<std::uint64_t, num_statuses> statuses = {};
+        // From the submission to the completion callback.
+        usb_latency_histogram_snapshot round_trip;
+        // From the completion callback to the invocation of the handler.
+        usb_latency_histogram_snapshot queueing_delay;
+
+        [[nodiscard]] auto errors(usb_transfer_errc const errc) const noexcept -> std::uint64_t
+        {
+            return statuses[static_cast<std::size_t>(errc)];
+        }
+    };
+
+    // Counters of one endpoint. Updated with relaxed atomics, so snapshots
+    // can be taken from any thread without locking, but the counters of
+    // a snapshot are not necessarily consistent with each other.
+    class usb_endpoint_statistics
+    {
+      public:
+        void record_submit() noexcept
+        {
+            submitted_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void record_submit_error() noexcept
+        {
+            submit_errors_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void record_completion(
+            ::libusb_transfer_status const status,
+            std::size_t const bytes,
+            std::chrono::nanoseconds const round_trip) noexcept
+        {
+            completed_.fetch_add(1, std::memory_order_relaxed);
+            bytes_.fetch_add(bytes, std::memory_order_relaxed);
+            if (static_cast<std::size_t>(status) < statuses_.size())
+            {
+                statuses_[static_cast<std::size_t>(status)].fetch_add(1, std::memory_order_relaxed);
+            }
+            round_trip_.record(round_trip);
+        }
+
+        void record_queueing_delay(std::chrono::nanoseconds const delay) noexcept
+        {
+            queueing_delay_.record(delay);
+        }
+
+        [[nodiscard]] auto snapshot(std::uint8_t const endpoint) const noexcept -> usb_endpoint_statistics_snapshot
+        {
+            auto snapshot = usb_endpoint_statistics_snapshot{
+                .endpoint = endpoint,
+                .submitted = submitted_.load(std::memory_order_relaxed),
+                .submit_errors = submit_errors_.load(std::memory_order_relaxed),
+                .completed = completed_.load(std::memory_order_relaxed),
+                .bytes = bytes_.load(std::memory_order_relaxed),
+                .statuses = {},
+                .round_trip = round_trip_.snapshot(),
+                .queueing_delay = queueing_delay_.snapshot(),
+            };
+            for (auto index = std::size_t{0}; index < statuses_.size(); ++index)
+            {
+                snapshot.statuses[index] = statuses_[index].load(std::memory_order_relaxed);
+            }
+            return snapshot;
+        }
+
+      private:
+        std::atomic<std::uint64_t> submitted_ = 0;
+        std::atomic<std::uint64_t> submit_errors_ = 0;
+        std::atomic<std::uint64_t> completed_ = 0;
+        std::atomic<std::uint64_t> bytes_ = 0;
+        std::array<std::atomic<std::uint64_t>, usb_endpoint_statistics_snapshot::num_statuses> statuses_ = {};
+        usb_latency_histogram round_trip_;
+        usb_latency_histogram queueing_delay_;
+    };
+
+    // Statistics of all endpoints of a device, control transfers are counted on endpoints 0x00 and 0x80.
+    class usb_device_statistics
+    {
+      public:
+        [[nodiscard]] auto endpoint(std::uint8_t const address) noexcept -> usb_endpoint_statistics&
+        {
+            return endpoints_[endpoint_slot(address)];
+        }
+
+        [[nodiscard]] auto snapshot(std::uint8_t const address) const noexcept -> usb_endpoint_statistics_snapshot
+        {
+            return endpoints_[endpoint_slot(address)].snapshot(address);
+        }
+
+        // The endpoints that had any transfers submitted.
+        [[nodiscard]] auto snapshot() const -> std::vector<usb_endpoint_statistics_snapshot>
+        {
+            auto snapshots = std::vector<usb_endpoint_statistics_snapshot>{};
+            for (auto slot = std::size_t{0}; slot < endpoints_.size(); ++slot)
+            {
+                auto const address = static_cast<std::uint8_t>((slot & 0x0Fu) | ((slot & 0x10u) << 3u));
+                auto snapshot = endpoints_[slot].snapshot(address);
+                if (snapshot.submitted != 0)
+                {
+                    snapshots.push_back(snapshot);
+                }
+            }
+            return snapshots;
+        }
+
+      private:
+        std::array<usb_endpoint_statistics, 32> endpoints_;
+
+        [[nodiscard]] static auto endpoint_slot(std::uint8_t const address) noexcept -> std::size_t
+        {
+            return (address & LIBUSB_ENDPOINT_ADDRESS_MASK) | ((address & LIBUSB_ENDPOINT_DIR_MASK) >> 3u);
+        }
+    };
+
+    namespace detail
+    {
+        struct usb_no_statistics
+        {
+        };
+
+        using usb_device_statistics_ptr = std::conditional_t<
+            usb_statistics_enabled,
+            std::shared_ptr<usb_device_statistics>,
+            usb_no_statistics>;
+
+        [[nodiscard]] inline auto make_usb_device_statistics() -> usb_device_statistics_ptr
+        {
+#ifdef USB_ASIO_ENABLE_STATISTICS
+            return std::make_shared<usb_device_statistics>();
+#else
+            return {};
+#endif
+        }
+
+        // Timestamps of the operation in flight of one transfer
+        struct usb_transfer_probe
+        {
+            using clock = std::chrono::steady_clock;
+
+            std::shared_ptr<usb_device_statistics> device;
+            usb_endpoint_statistics* endpoint;
+            clock::time_point submitted = {};
+            std::atomic<clock::rep> completed = 0;
+
+            usb_transfer_probe(
+                std::shared_ptr<usb_device_statistics> device,
+                std::uint8_t const address) noexcept
+              : device{std::move(device)}
+              , endpoint{&this->device->endpoint(address)} { }
+
+            void on_submit() noexcept
+            {
+                submitted = clock::now();
+                endpoint->record_submit();
+            }
+
+            void on_submit_error() noexcept
+            {
+                endpoint->record_submit_error();
+                completed.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            void on_completion(::libusb_transfer_status const status, std::size_t const bytes) noexcept
+            {
+                auto const now = clock::now();
+                endpoint->record_completion(status, bytes, now - submitted);
+                completed.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            void on_upcall() noexcept
+            {
+                auto const completed_at = clock::time_point{clock::duration{completed.load(std::memory_order_relaxed)}};
+                endpoint->record_queueing_delay(clock::now() - completed_at);
+            }
+        };
+
+        using usb_transfer_probe_ptr = std::conditional_t<
+            usb_statistics_enabled,
+            std::shared_ptr<usb_transfer_probe>,
+            usb_no_statistics>;
+
+        // Records the queueing delay of the handler when invoked.
+        // Shares the probe, as the handler can outlive the transfer.
+        template <typename Handler>
+        class usb_timed_handler
+        {
+          public:
+            template <typename OtherHandler>
+            usb_timed_handler(std::shared_ptr<usb_transfer_probe> probe, OtherHandler&& handler)
+              : probe_{std::move(probe)}
+              , handler_{std::forward<OtherHandler>(handler)} { }
+
+            template <typename... Args>
+            void operator()(Args&&... args)
+            {
+                probe_->on_upcall();
+                std::move(handler_)(std::forward<Args>(args)...);
+            }
+
+            [[nodiscard]] auto handler() const noexcept -> Handler const&
+            {
+                return handler_;
+            }
+
+          private:
+            std::shared_ptr<usb_transfer_probe> probe_;
+            Handler handler_;
+        };
+
+        template <typename Handler>
+        usb_timed_handler(std::shared_ptr<usb_transfer_probe>, Handler&&) -> usb_timed_handler<std::decay_t<Handler>>;
+    }  // namespace detail
+}  // namespace usb_asio
+
+// The wrapper is transparent to the executor and allocator of the handler
+template <typename Handler, typename Executor>
+struct usb_asio::asio::associated_executor<usb_asio::detail::usb_timed_handler<Handler>, Executor>
+{
+    using type = typename usb_asio::asio::associated_executor<Handler, Executor>::type;
+
+    static auto get(usb_asio::detail::usb_timed_handler<Handler> const& handler, Executor const& executor = {}) noexcept
+        -> type
+    {
+        return usb_asio::asio::get_associated_executor(handler.handler(), executor);
+    }
+};
+
+template <typename Handler, typename Alloc>
+struct usb_asio::asio::associated_allocator<usb_asio::detail::usb_timed_handler<Handler>, Alloc>
+{
+    using type = typename usb_asio::asio::associated_allocator<Handler, Alloc>::type;
+
+    static auto get(usb_asio::detail::usb_timed_handler<Handler> const& handler, Alloc const& alloc = {}) noexcept
+        -> type
+    {
+        return usb_asio::asio::get_associated_allocator(handler.handler(), alloc);
+    }
+};
@@ -1,22 +1,128 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <memory_resource>
 #include <ranges>
 #include <span>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <libusb.h>
 #include "usb_asio/asio.hpp"
 #include "usb_asio/error.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/usb_deadline.hpp"
 #include "usb_asio/usb_device.hpp"
+#include "usb_asio/usb_scatter_gather.hpp"
+#include "usb_asio/usb_statistics.hpp"
+#include "usb_asio/usb_transfer_pool.hpp"
 
 namespace usb_asio
 {
+    // Payloads up to this size are stored inside a control transfer, see basic_usb_transfer::async_control.
+    inline constexpr auto usb_control_inline_payload_size = std::size_t{64};
+
+    namespace detail
+    {
+        // Receives the completions of the transfers of a batch (see async_submit_batch),
+        // on the thread handling libusb events, in place of a completion handler.
+        class usb_transfer_batch_listener
+        {
+          public:
+            virtual void on_transfer_complete(
+                std::size_t index,
+                error_code ec,
+                std::size_t transferred) noexcept = 0;
+
+          protected:
+            ~usb_transfer_batch_listener() noexcept = default;
+        };
+
+        // Receives the completion of an operation awaited by a coroutine (see use_awaiter.hpp),
+        // on the thread handling libusb events, in place of a completion handler.
+        template <typename Result>
+        class usb_transfer_awaiting
+        {
+          public:
+            virtual void on_transfer_complete(
+                usb_completion_dispatch dispatch,
+                error_code ec,
+                Result result) noexcept = 0;
+
+          protected:
+            ~usb_transfer_awaiting() noexcept = default;
+        };
+
+        template <typename Transfer, typename SubmitFn>
+        class usb_transfer_awaiter;
+
+        // Setup packet and payload of the control requests made without a usb_control_transfer_buffer
+        struct usb_control_storage
+        {
+            // Requests with a payload up to usb_control_inline_payload_size
+            alignas(std::uint16_t) std::array<
+                std::byte,
+                LIBUSB_CONTROL_SETUP_SIZE + usb_control_inline_payload_size> inline_data = {};
+            // Larger requests, grown as needed and kept for the next ones
+            std::pmr::vector<std::uint16_t> staging = {};
+            // Where the received payload of an IN request is copied on completion
+            std::byte* copy_out_data = nullptr;
+            std::size_t copy_out_size = 0;
+        };
+
+        struct usb_no_control_storage
+        {
+        };
+
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+        // Clears the cancellation slot of the handler, which refers to the transfer,
+        // on the handler's executor before invoking it.
+        template <typename Handler>
+        class usb_slot_clearing_handler
+        {
+          public:
+            template <typename OtherHandler>
+            usb_slot_clearing_handler(asio::cancellation_slot const& slot, OtherHandler&& handler)
+              : slot_{slot}
+              , handler_{std::forward<OtherHandler>(handler)} { }
+
+            template <typename... Args>
+            void operator()(Args&&... args)
+            {
+                slot_.clear();
+                std::move(handler_)(std::forward<Args>(args)...);
+            }
+
+            [[nodiscard]] auto handler() const noexcept -> Handler const&
+            {
+                return handler_;
+            }
+
+          private:
+            asio::cancellation_slot slot_;
+            Handler handler_;
+        };
+
+        template <typename Handler>
+        usb_slot_clearing_handler(asio::cancellation_slot const&, Handler&&)
+            -> usb_slot_clearing_handler<std::decay_t<Handler>>;
+#endif
+
+        struct usb_transfer_access;
+    }  // namespace detail
+
+    struct use_awaiter_t;
+
     class usb_control_transfer_buffer
     {
       public:
@@ -26,18 +132,19 @@ namespace usb_asio
         usb_control_transfer_buffer(
             std::size_t const size,
             std::pmr::memory_resource* const mem_resource)
-          : data_(((size - 1u) / 2u) + 1u + LIBUSB_CONTROL_SETUP_SIZE, mem_resource) { }
+          : data_((LIBUSB_CONTROL_SETUP_SIZE + size + 1u) / 2u, mem_resource)
+          , size_{size} { }
 
         [[nodiscard]] auto payload() noexcept -> std::span<std::byte>
         {
             return std::as_writable_bytes(std::span{data_})
-                .subspan(LIBUSB_CONTROL_SETUP_SIZE);
+                .subspan(LIBUSB_CONTROL_SETUP_SIZE, size_);
         }
 
         [[nodiscard]] auto payload() const noexcept -> std::span<std::byte const>
         {
             return std::as_bytes(std::span{data_})
-                .subspan(LIBUSB_CONTROL_SETUP_SIZE);
+                .subspan(LIBUSB_CONTROL_SETUP_SIZE, size_);
         }
 
         [[nodiscard]] auto data() noexcept -> std::byte*
@@ -56,7 +163,9 @@ namespace usb_asio
         }
 
       private:
+        // The setup packet followed by the payload, aligned for its 16 bit fields
         std::pmr::vector<std::uint16_t> data_;
+        std::size_t size_;
     };
 
     inline constexpr auto usb_no_timeout = std::chrono::milliseconds{0};
@@ -101,6 +210,9 @@ namespace usb_asio
 
         static constexpr auto transfer_type = transfer_type_;
         static constexpr auto transfer_direction = transfer_direction_;
+        static constexpr auto is_scatter_gather_capable = transfer_type == usb_transfer_type::bulk
+                                                          || transfer_type == usb_transfer_type::interrupt
+                                                          || transfer_type == usb_transfer_type::bulk_stream;
 
         // clang-format off
         template <typename OtherExecutor>
@@ -110,19 +222,9 @@ namespace usb_asio
             std::chrono::milliseconds const timeout = usb_no_timeout)
         requires (transfer_type == usb_transfer_type::control)
           // clang-format on
-          : handle_{::libusb_alloc_transfer(0)}
-          , executor_{executor}
-          , completion_context_{std::make_unique<completion_context>()}
+          : basic_usb_transfer{executor, allocate_resources(0)}
         {
-            check_is_constructed();
-
-            ::libusb_fill_control_transfer(
-                handle(),
-                device.handle(),
-                nullptr,
-                &completion_callback,
-                completion_context_.get(),
-                static_cast<unsigned>(timeout.count()));
+            init_control(device, timeout);
         }
 
         // clang-format off
@@ -132,7 +234,7 @@ namespace usb_asio
             std::chrono::milliseconds const timeout = usb_no_timeout)
         requires (transfer_type == usb_transfer_type::control)
           // clang-format on
-          : basic_usb_transfer{device.get_executor(), timeout}
+          : basic_usb_transfer{device.get_executor(), device, timeout}
         {
         }
 
@@ -149,30 +251,9 @@ namespace usb_asio
             && std::ranges::sized_range<PacketSizeRange>
             && std::unsigned_integral<std::ranges::range_value_t<PacketSizeRange>>
           // clang-format on
-          : handle_{::libusb_alloc_transfer(static_cast<int>(std::ranges::size(packet_sizes)))},
-            executor_{executor}, completion_context_{std::make_unique<completion_context>()}
+          : basic_usb_transfer{executor, allocate_resources(std::ranges::size(packet_sizes))}
         {
-            check_is_constructed();
-
-            auto const num_packets = std::ranges::size(packet_sizes);
-            completion_context_->result_storage.resize(num_packets);
-
-            auto packet = std::size_t{0};
-            for (auto const packet_size : packet_sizes)
-            {
-                handle()->iso_packet_desc[packet++].length = static_cast<unsigned>(packet_size);
-            }
-
-            ::libusb_fill_iso_transfer(
-                handle(),
-                device.handle(),
-                endpoint,
-                nullptr,
-                0,
-                static_cast<int>(num_packets),
-                &completion_callback,
-                completion_context_.get(),
-                static_cast<unsigned>(timeout.count()));
+            init_isochronous(device, endpoint, packet_sizes, timeout);
         }
 
         // clang-format off
@@ -249,21 +330,9 @@ namespace usb_asio
             std::chrono::milliseconds const timeout = usb_no_timeout)
         requires (transfer_type == usb_transfer_type::bulk)
           // clang-format on
-          : handle_{::libusb_alloc_transfer(0)}
-          , executor_{executor}
-          , completion_context_{std::make_unique<completion_context>()}
+          : basic_usb_transfer{executor, allocate_resources(0)}
         {
-            check_is_constructed();
-
-            ::libusb_fill_bulk_transfer(
-                handle(),
-                device.handle(),
-                endpoint,
-                nullptr,
-                0,
-                &completion_callback,
-                completion_context_.get(),
-                static_cast<unsigned>(timeout.count()));
+            init_bulk(device, endpoint, timeout);
         }
 
         // clang-format off
@@ -292,21 +361,9 @@ namespace usb_asio
             std::chrono::milliseconds const timeout = usb_no_timeout)
         requires (transfer_type == usb_transfer_type::interrupt)
           // clang-format on
-          : handle_{::libusb_alloc_transfer(0)}
-          , executor_{executor}
-          , completion_context_{std::make_unique<completion_context>()}
+          : basic_usb_transfer{executor, allocate_resources(0)}
         {
-            check_is_constructed();
-
-            ::libusb_fill_interrupt_transfer(
-                handle(),
-                device.handle(),
-                endpoint,
-                nullptr,
-                0,
-                &completion_callback,
-                completion_context_.get(),
-                static_cast<unsigned>(timeout.count()));
+            init_interrupt(device, endpoint, timeout);
         }
 
         // clang-format off
@@ -336,22 +393,9 @@ namespace usb_asio
             std::chrono::milliseconds const timeout = usb_no_timeout)
         requires (transfer_type == usb_transfer_type::bulk_stream)
           // clang-format on
-          : handle_{::libusb_alloc_transfer(0)}
-          , executor_{executor}
-          , completion_context_{std::make_unique<completion_context>()}
+          : basic_usb_transfer{executor, allocate_resources(0)}
         {
-            check_is_constructed();
-
-            ::libusb_fill_bulk_stream_transfer(
-                handle(),
-                device.handle(),
-                endpoint,
-                stream_id,
-                nullptr,
-                0,
-                &completion_callback,
-                completion_context_.get(),
-                static_cast<unsigned>(timeout.count()));
+            init_bulk_stream(device, endpoint, stream_id, timeout);
         }
 
         // clang-format off
@@ -373,11 +417,108 @@ namespace usb_asio
         {
         }
 
+        // Constructors from a usb_transfer_pool, recycling the allocations of the pool's transfers.
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_transfer(
+            usb_transfer_pool& pool,
+            basic_usb_device<OtherExecutor>& device,
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::control)
+          // clang-format on
+          : basic_usb_transfer{
+              device.get_executor(),
+              pool.acquire(pool_key(device, static_cast<std::uint8_t>(transfer_direction), 0)),
+          }
+        {
+            init_control(device, timeout);
+        }
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_transfer(
+            usb_transfer_pool& pool,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::size_t const num_packets,
+            std::size_t const packet_size,
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::isochronous)
+          // clang-format on
+          : basic_usb_transfer{device.get_executor(), pool.acquire(pool_key(device, endpoint, num_packets))}
+        {
+            init_isochronous(
+                device,
+                endpoint,
+                std::views::iota(std::size_t{0}, num_packets)
+                    | std::views::transform([&](auto) { return packet_size; }),
+                timeout);
+        }
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_transfer(
+            usb_transfer_pool& pool,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk) || (transfer_type == usb_transfer_type::interrupt)
+          // clang-format on
+          : basic_usb_transfer{device.get_executor(), pool.acquire(pool_key(device, endpoint, 0))}
+        {
+            if constexpr (transfer_type == usb_transfer_type::bulk)
+            {
+                init_bulk(device, endpoint, timeout);
+            }
+            else
+            {
+                init_interrupt(device, endpoint, timeout);
+            }
+        }
+
+        // clang-format off
+        template <std::convertible_to<executor_type> OtherExecutor>
+        basic_usb_transfer(
+            usb_transfer_pool& pool,
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::uint32_t const stream_id,
+            std::chrono::milliseconds const timeout = usb_no_timeout)
+        requires (transfer_type == usb_transfer_type::bulk_stream)
+          // clang-format on
+          : basic_usb_transfer{device.get_executor(), pool.acquire(pool_key(device, endpoint, 0))}
+        {
+            init_bulk_stream(device, endpoint, stream_id, timeout);
+        }
+
+        basic_usb_transfer(basic_usb_transfer&&) noexcept = default;
+
+        ~basic_usb_transfer() noexcept
+        {
+            recycle();
+        }
+
         [[nodiscard]] auto handle() const noexcept -> handle_type
         {
             return handle_.get();
         }
 
+        [[nodiscard]] auto get_executor() const noexcept -> executor_type
+        {
+            return executor_;
+        }
+
+        [[nodiscard]] auto completion_dispatch() const noexcept -> usb_completion_dispatch
+        {
+            return completion_context_->dispatch;
+        }
+
+        void set_completion_dispatch(usb_completion_dispatch const dispatch) noexcept
+        {
+            completion_context_->dispatch = dispatch;
+        }
+
         void cancel()
         {
             try_with_ec([&](auto& ec) {
@@ -387,7 +528,24 @@ namespace usb_asio
 
         void cancel(error_code& ec) noexcept
         {
-            libusb_try(ec, ::libusb_cancel_transfer, handle());
+            cancel_operation(handle(), *completion_context_, ec);
+        }
+
+        // clang-format off
+        [[nodiscard]] auto scatter_gather_options() const noexcept -> usb_scatter_gather_options
+        requires is_scatter_gather_capable
+        // clang-format on
+        {
+            auto const& scatter_gather = completion_context_->scatter_gather;
+            return scatter_gather != nullptr ? scatter_gather->options() : usb_scatter_gather_options{};
+        }
+
+        // clang-format off
+        void set_scatter_gather_options(usb_scatter_gather_options const& options)
+        requires is_scatter_gather_capable
+        // clang-format on
+        {
+            scatter_gather().set_options(options);
         }
 
         // clang-format off
@@ -416,6 +574,41 @@ namespace usb_asio
             return async_submit_impl(std::forward<CompletionToken>(token));
         }
 
+        // Reads into a buffer sequence, as if it was one contiguous buffer.
+        // Buffers smaller than scatter_gather_options().copy_threshold are read through
+        // a staging buffer, larger ones in place by transfers of their own.
+        // clang-format off
+        template <
+            typename MutableBufferSequence,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_read_some(MutableBufferSequence const& buffers, CompletionToken&& token = {})
+        requires (transfer_direction == usb_transfer_direction::in)
+            && is_scatter_gather_capable
+            && asio::is_mutable_buffer_sequence<MutableBufferSequence>::value
+            && (!std::convertible_to<MutableBufferSequence, asio::mutable_buffer>)
+        // clang-format on
+        {
+            return async_submit_scattered(buffers, std::forward<CompletionToken>(token));
+        }
+
+        // Writes a buffer sequence, as if it was one contiguous buffer.
+        // Buffers smaller than scatter_gather_options().copy_threshold are copied
+        // into a staging buffer, larger ones are written in place by transfers of their own,
+        // all submitted at once.
+        // clang-format off
+        template <
+            typename ConstBufferSequence,
+            typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_write_some(ConstBufferSequence const& buffers, CompletionToken&& token = {})
+        requires (transfer_direction == usb_transfer_direction::out)
+            && is_scatter_gather_capable
+            && asio::is_const_buffer_sequence<ConstBufferSequence>::value
+            && (!std::convertible_to<ConstBufferSequence, asio::const_buffer>)
+        // clang-format on
+        {
+            return async_submit_scattered(buffers, std::forward<CompletionToken>(token));
+        }
+
         // clang-format off
         template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
         auto async_control(
@@ -423,115 +616,353 @@ namespace usb_asio
             usb_control_request_type const type,
             std::uint8_t const request,
             std::uint16_t const value,
-            std::uint8_t const index,
+            std::uint16_t const index,
             usb_control_transfer_buffer& buffer,
             CompletionToken&& token = {})
         requires (transfer_type == usb_transfer_type::control)
         // clang-format on
         {
-            handle()->buffer = reinterpret_cast<unsigned char*>(buffer.data());
+            auto const setup = buffer.data() - LIBUSB_CONTROL_SETUP_SIZE;
+            handle()->buffer = reinterpret_cast<unsigned char*>(setup);
             handle()->length = static_cast<int>(buffer.size() + LIBUSB_CONTROL_SETUP_SIZE);
+            completion_context_->control.copy_out_data = nullptr;
 
-            ::libusb_fill_control_setup(
-                reinterpret_cast<unsigned char*>(buffer.data() - LIBUSB_CONTROL_SETUP_SIZE),
-                static_cast<std::uint8_t>(
-                    static_cast<unsigned>(recipient)
-                    | static_cast<unsigned>(type)
-                    | static_cast<unsigned>(transfer_direction)),
-                request,
-                value,
-                index,
-                buffer.size());
+            fill_control_setup(setup, recipient, type, request, value, index, buffer.size());
 
             return async_submit_impl(std::forward<CompletionToken>(token));
         }
 
-      private:
-        class completion_handler_t
+        // Sends a control request without a separately owned buffer. The data is copied into
+        // the transfer: up to usb_control_inline_payload_size bytes into storage inside it,
+        // larger payloads into a staging buffer that is kept for the next requests.
+        // The setup packet is reused when only wValue or wIndex change.
+        // clang-format off
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_control(
+            usb_control_request_recipient const recipient,
+            usb_control_request_type const type,
+            std::uint8_t const request,
+            std::uint16_t const value,
+            std::uint16_t const index,
+            asio::const_buffer const data,
+            CompletionToken&& token = {})
+        requires (transfer_type == usb_transfer_type::control)
+            && (transfer_direction == usb_transfer_direction::out)
+        // clang-format on
         {
-          public:
-            completion_handler_t() = default;
-
-            template <
-                std::invocable<error_code, result_type> T>
-            completion_handler_t(Executor const& executor, T&& handler)
-            {
-                auto const trackedEx = asio::prefer(executor, asio::execution::outstanding_work.tracked);
-                auto const trackedCompletionEx = asio::prefer(
-                    asio::get_associated_executor(handler, executor),
-                    asio::execution::outstanding_work.tracked);
-
-                impl_ = std::make_unique<handler_impl<
-                    T,
-                    std::decay_t<decltype(trackedEx)>,
-                    std::decay_t<decltype(trackedCompletionEx)>>>(
-                    trackedEx,
-                    trackedCompletionEx,
-                    std::move(handler));
-            }
-
-            void operator()(error_code const ec, result_type result)
+            auto const setup = control_storage(data.size());
+            if (data.size() != 0)
             {
-                (*impl_)(ec, std::move(result));
+                std::memcpy(setup + LIBUSB_CONTROL_SETUP_SIZE, data.data(), data.size());
             }
+            fill_control_setup(setup, recipient, type, request, value, index, data.size());
 
-            void reset() noexcept
-            {
-                impl_.reset();
-            }
+            return async_submit_impl(std::forward<CompletionToken>(token));
+        }
 
-          private:
-            struct erased_handler
-            {
-                virtual ~erased_handler() noexcept = default;
+        // Reads a control request without a separately owned buffer, like the OUT overload.
+        // The received payload is copied into the buffer on completion.
+        // clang-format off
+        template <typename CompletionToken = asio::default_completion_token_t<executor_type>>
+        auto async_control(
+            usb_control_request_recipient const recipient,
+            usb_control_request_type const type,
+            std::uint8_t const request,
+            std::uint16_t const value,
+            std::uint16_t const index,
+            asio::mutable_buffer const data,
+            CompletionToken&& token = {})
+        requires (transfer_type == usb_transfer_type::control)
+            && (transfer_direction == usb_transfer_direction::in)
+        // clang-format on
+        {
+            auto const setup = control_storage(data.size());
+            completion_context_->control.copy_out_data = static_cast<std::byte*>(data.data());
+            completion_context_->control.copy_out_size = data.size();
+            fill_control_setup(setup, recipient, type, request, value, index, data.size());
 
-                virtual void operator()(error_code ec, result_type&& result) = 0;
-            };
+            return async_submit_impl(std::forward<CompletionToken>(token));
+        }
 
-            template <std::invocable<error_code, result_type> T,
-                      typename TrackedExecutor,
-                      typename TrackedCompletionExecutor>
-            struct handler_impl final : erased_handler
+        auto operator=(basic_usb_transfer&& other) noexcept -> basic_usb_transfer&
+        {
+            if (this != &other)
             {
-                TrackedExecutor executor;
-                TrackedCompletionExecutor completion_executor;
-                T handler;
-
-                handler_impl(
-                    TrackedExecutor const& executor,
-                    TrackedCompletionExecutor const& completion_executor,
-                    T&& handler)
-                  : executor{executor}
-                  , completion_executor{completion_executor}
-                  , handler{std::move(handler)} { }
-
-                void operator()(error_code const ec, result_type&& result) override
-                {
-                    asio::post(
-                        completion_executor,
-                        std::bind_front(std::move(handler), ec, std::move(result)));
-                }
-            };
+                recycle();
+                handle_ = std::move(other.handle_);
+                executor_ = std::move(other.executor_);
+                completion_context_ = std::move(other.completion_context_);
+                pool_ = std::move(other.pool_);
+                pool_key_ = other.pool_key_;
+            }
+            return *this;
+        }
 
-            std::unique_ptr<erased_handler> impl_;
-        };
+      private:
+        using completion_handler_t = detail::completion_handler<Executor, error_code, result_type>;
 
         struct completion_context
         {
             [[no_unique_address]] typename traits_type::result_storage_type result_storage = {};
             completion_handler_t handler = {};
+            usb_completion_dispatch dispatch = usb_completion_dispatch::post;
+            [[no_unique_address]] detail::usb_transfer_probe_ptr probe = {};
+            [[no_unique_address]] std::conditional_t<
+                transfer_type == usb_transfer_type::control,
+                detail::usb_control_storage,
+                detail::usb_no_control_storage> control = {};
+            // Set instead of the handler while awaited by a coroutine
+            detail::usb_transfer_awaiting<result_type>* awaiting = nullptr;
+            // Set instead of the handler while submitted as part of a batch
+            detail::usb_transfer_batch_listener* batch = nullptr;
+            std::size_t batch_index = 0;
+            // Created on the first transfer of a buffer sequence
+            std::unique_ptr<detail::usb_scatter_gather> scatter_gather = nullptr;
+            bool is_scattered = false;
+            // Of the operation, when submitted with_deadline
+            detail::usb_deadline deadline = {};
+            // Of the service, looked up on the first deadline
+            detail::usb_timer_wheel* timer_wheel = nullptr;
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+            // Counts the completions, so that a cancellation slot only cancels the operation it was connected for
+            std::atomic<std::uint64_t> num_completions = 0;
+#endif
+        };
+
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+        // Installed in the cancellation slot of a completion handler, which is cleared
+        // before the handler is invoked (see detail::usb_slot_clearing_handler).
+        // A cancelled transfer reports what it transferred, but libusb_cancel_transfer
+        // cannot undo a partial transfer, so total cancellation is not supported.
+        class cancellation_handler
+        {
+          public:
+            cancellation_handler(handle_type const handle, completion_context& context) noexcept
+              : handle_{handle}
+              , context_{&context}
+              , operation_{context.num_completions.load(std::memory_order_relaxed)} { }
+
+            void operator()(asio::cancellation_type const type) noexcept
+            {
+                constexpr auto supported = asio::cancellation_type::terminal | asio::cancellation_type::partial;
+                if ((type & supported) == asio::cancellation_type::none) { return; }
+                // Completed already
+                if (context_->num_completions.load(std::memory_order_relaxed) != operation_) { return; }
+
+                auto ec = error_code{};
+                cancel_operation(handle_, *context_, ec);
+            }
+
+          private:
+            handle_type handle_;
+            completion_context* context_;
+            std::uint64_t operation_;
         };
+#endif
+
+        friend detail::usb_transfer_access;
 
         unique_handle_type handle_;
         executor_type executor_;
         std::unique_ptr<completion_context> completion_context_;
+        // The pool the allocations are given back to, if any
+        std::shared_ptr<detail::usb_transfer_pool_state> pool_;
+        detail::usb_transfer_pool_key pool_key_;
 
-        static void completion_callback(handle_type const handle) noexcept
+        basic_usb_transfer(executor_type const& executor, detail::usb_transfer_resources&& resources)
+          : handle_{std::move(resources.handle)}
+          , executor_{executor}
+          , completion_context_{
+                resources.context != nullptr
+                    ? std::unique_ptr<completion_context>{static_cast<completion_context*>(resources.context.release())}
+                    : std::make_unique<completion_context>()}
+          , pool_{std::move(resources.pool)}
+          , pool_key_{resources.key}
         {
+            check_is_constructed();
+        }
+
+        [[nodiscard]] static auto allocate_resources(std::size_t const num_iso_packets) -> detail::usb_transfer_resources
+        {
+            return detail::usb_transfer_resources{
+                .handle = unique_handle_type{::libusb_alloc_transfer(static_cast<int>(num_iso_packets))},
+            };
+        }
+
+        template <typename OtherExecutor>
+        [[nodiscard]] static auto pool_key(
+            basic_usb_device<OtherExecutor> const& device,
+            std::uint8_t const endpoint,
+            std::size_t const num_iso_packets) noexcept -> detail::usb_transfer_pool_key
+        {
+            return detail::usb_transfer_pool_key{
+                .device = device.handle(),
+                .endpoint = endpoint,
+                .type = transfer_type,
+                .num_iso_packets = static_cast<int>(num_iso_packets),
+                .destroy_context = &destroy_context,
+            };
+        }
+
+        static void destroy_context(void* const context) noexcept
+        {
+            delete static_cast<completion_context*>(context);
+        }
+
+        // Gives the allocations back to the pool the transfer was constructed from.
+        // The libusb transfer is filled again by the next transfer using it.
+        void recycle() noexcept
+        {
+            if (pool_ == nullptr || handle_ == nullptr || completion_context_ == nullptr) { return; }
+
+            auto& context = *completion_context_;
+            context.handler.reset();
+            context.dispatch = usb_completion_dispatch::post;
+            context.awaiting = nullptr;
+            context.batch = nullptr;
+            context.is_scattered = false;
+            // The pool may outlive the service
+            context.timer_wheel = nullptr;
+            if constexpr (transfer_type == usb_transfer_type::control)
+            {
+                context.control.copy_out_data = nullptr;
+            }
+            if (context.scatter_gather != nullptr)
+            {
+                context.scatter_gather->set_options({});
+            }
+            handle()->flags = 0;
+
+            auto const pool = std::move(pool_);
+            pool->recycle(detail::usb_transfer_resources{
+                .handle = std::move(handle_),
+                .context = detail::usb_transfer_context_ptr{
+                    completion_context_.release(),
+                    detail::usb_transfer_context_deleter{&destroy_context},
+                },
+                .key = pool_key_,
+            });
+        }
+
+        template <typename OtherExecutor>
+        void init_control(basic_usb_device<OtherExecutor>& device, std::chrono::milliseconds const timeout)
+        {
+            attach_statistics(device, static_cast<std::uint8_t>(transfer_direction));
+
+            ::libusb_fill_control_transfer(
+                handle(),
+                device.handle(),
+                nullptr,
+                &completion_callback,
+                completion_context_.get(),
+                static_cast<unsigned>(timeout.count()));
+        }
+
+        template <typename OtherExecutor, typename PacketSizeRange>
+        void init_isochronous(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            PacketSizeRange&& packet_sizes,
+            std::chrono::milliseconds const timeout)
+        {
+            attach_statistics(device, endpoint);
+
+            auto const num_packets = std::ranges::size(packet_sizes);
+            completion_context_->result_storage.resize(num_packets);
+
+            auto packet = std::size_t{0};
+            for (auto const packet_size : packet_sizes)
+            {
+                handle()->iso_packet_desc[packet++].length = static_cast<unsigned>(packet_size);
+            }
+
+            ::libusb_fill_iso_transfer(
+                handle(),
+                device.handle(),
+                endpoint,
+                nullptr,
+                0,
+                static_cast<int>(num_packets),
+                &completion_callback,
+                completion_context_.get(),
+                static_cast<unsigned>(timeout.count()));
+        }
+
+        template <typename OtherExecutor>
+        void init_bulk(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::chrono::milliseconds const timeout)
+        {
+            attach_statistics(device, endpoint);
+
+            ::libusb_fill_bulk_transfer(
+                handle(),
+                device.handle(),
+                endpoint,
+                nullptr,
+                0,
+                &completion_callback,
+                completion_context_.get(),
+                static_cast<unsigned>(timeout.count()));
+        }
+
+        template <typename OtherExecutor>
+        void init_interrupt(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::chrono::milliseconds const timeout)
+        {
+            attach_statistics(device, endpoint);
+
+            ::libusb_fill_interrupt_transfer(
+                handle(),
+                device.handle(),
+                endpoint,
+                nullptr,
+                0,
+                &completion_callback,
+                completion_context_.get(),
+                static_cast<unsigned>(timeout.count()));
+        }
+
+        template <typename OtherExecutor>
+        void init_bulk_stream(
+            basic_usb_device<OtherExecutor>& device,
+            std::uint8_t const endpoint,
+            std::uint32_t const stream_id,
+            std::chrono::milliseconds const timeout)
+        {
+            attach_statistics(device, endpoint);
+
+            ::libusb_fill_bulk_stream_transfer(
+                handle(),
+                device.handle(),
+                endpoint,
+                stream_id,
+                nullptr,
+                0,
+                &completion_callback,
+                completion_context_.get(),
+                static_cast<unsigned>(timeout.count()));
+        }
+
+        static void completion_callback(handle_type const handle) noexcept
+        {
+            auto& context = *static_cast<completion_context*>(handle->user_data);
+            if (context.deadline.wheel != nullptr
+                && context.deadline.wheel->disarm(context.deadline)
+                && handle->status == ::LIBUSB_TRANSFER_CANCELLED)
+            {
+                handle->status = ::LIBUSB_TRANSFER_TIMED_OUT;
+            }
+
             auto const ec = error_code{
                 static_cast<usb_transfer_errc>(handle->status),
             };
-            auto& context = *static_cast<completion_context*>(handle->user_data);
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+            context.num_completions.fetch_add(1, std::memory_order_relaxed);
+#endif
 
             auto const result = [&]() {
                 if constexpr (transfer_type == usb_transfer_type::isochronous)
@@ -556,31 +987,358 @@ namespace usb_asio
                 }
             }();
 
-            context.handler(ec, result);
-            context.handler.reset();
+            if constexpr (transfer_type == usb_transfer_type::control
+                          && transfer_direction == usb_transfer_direction::in)
+            {
+                auto& control = context.control;
+                if (control.copy_out_data != nullptr)
+                {
+                    std::memcpy(
+                        std::exchange(control.copy_out_data, nullptr),
+                        handle->buffer + LIBUSB_CONTROL_SETUP_SIZE,
+                        std::min(static_cast<std::size_t>(result), control.copy_out_size));
+                }
+            }
+
+            if constexpr (usb_statistics_enabled)
+            {
+                context.probe->on_completion(handle->status, transferred_bytes(result));
+            }
+
+            // A scattered transfer completing before its submission returned is on the initiating thread
+            auto const dispatch = context.is_scattered && context.scatter_gather->completes_inline()
+                                      ? usb_completion_dispatch::post
+                                      : context.dispatch;
+
+            if (context.awaiting != nullptr)
+            {
+                std::exchange(context.awaiting, nullptr)->on_transfer_complete(dispatch, ec, result);
+                return;
+            }
+
+            if (context.batch != nullptr)
+            {
+                std::exchange(context.batch, nullptr)->on_transfer_complete(
+                    context.batch_index,
+                    ec,
+                    transferred_bytes(result));
+                return;
+            }
+
+            context.handler(dispatch, ec, result);
+        }
+
+        static void expire_deadline(handle_type const handle) noexcept
+        {
+            auto ec = error_code{};
+            cancel_operation(handle, *static_cast<completion_context*>(handle->user_data), ec);
+        }
+
+        static void cancel_operation(
+            handle_type const handle,
+            completion_context& context,
+            error_code& ec) noexcept
+        {
+            if (context.is_scattered)
+            {
+                context.scatter_gather->cancel();
+                return;
+            }
+
+            libusb_try(ec, ::libusb_cancel_transfer, handle);
+        }
+
+        [[nodiscard]] static auto transferred_bytes(result_type const& result) noexcept -> std::size_t
+        {
+            if constexpr (transfer_type == usb_transfer_type::isochronous)
+            {
+                auto bytes = std::size_t{0};
+                for (auto const& packet_result : result)
+                {
+                    bytes += packet_result.transferred;
+                }
+                return bytes;
+            }
+            else
+            {
+                return static_cast<std::size_t>(result);
+            }
+        }
+
+        // Points the libusb transfer at storage of the control transfer for the payload size,
+        // returning the setup packet.
+        [[nodiscard]] auto control_storage(std::size_t const payload_size) -> std::byte*
+        {
+            auto& control = completion_context_->control;
+            control.copy_out_data = nullptr;
+
+            auto setup = control.inline_data.data();
+            if (payload_size > usb_control_inline_payload_size)
+            {
+                auto const num_elements = (LIBUSB_CONTROL_SETUP_SIZE + payload_size + 1u) / 2u;
+                if (control.staging.size() < num_elements)
+                {
+                    control.staging.resize(num_elements);
+                }
+                setup = reinterpret_cast<std::byte*>(control.staging.data());
+            }
+
+            handle()->buffer = reinterpret_cast<unsigned char*>(setup);
+            handle()->length = static_cast<int>(LIBUSB_CONTROL_SETUP_SIZE + payload_size);
+            return setup;
+        }
+
+        static void fill_control_setup(
+            std::byte* const setup,
+            usb_control_request_recipient const recipient,
+            usb_control_request_type const type,
+            std::uint8_t const request,
+            std::uint16_t const value,
+            std::uint16_t const index,
+            std::size_t const payload_size) noexcept
+        {
+            auto const request_type = static_cast<std::uint8_t>(
+                static_cast<unsigned>(recipient)
+                | static_cast<unsigned>(type)
+                | static_cast<unsigned>(transfer_direction));
+            auto const length = static_cast<std::uint16_t>(payload_size);
+
+            auto& packet = *reinterpret_cast<::libusb_control_setup*>(setup);
+            if (packet.bmRequestType == request_type
+                && packet.bRequest == request
+                && packet.wLength == ::libusb_cpu_to_le16(length))
+            {
+                packet.wValue = ::libusb_cpu_to_le16(value);
+                packet.wIndex = ::libusb_cpu_to_le16(index);
+                return;
+            }
+
+            ::libusb_fill_control_setup(
+                reinterpret_cast<unsigned char*>(setup),
+                request_type,
+                request,
+                value,
+                index,
+                length);
+        }
+
+        // Submits without a completion handler, the completion is reported to the awaiter.
+        template <typename SubmitFn>
+        void submit_awaited(
+            detail::usb_transfer_awaiting<result_type>& awaiting,
+            SubmitFn& submit,
+            error_code& ec) noexcept
+        {
+            completion_context_->awaiting = &awaiting;
+            if constexpr (usb_statistics_enabled)
+            {
+                completion_context_->probe->on_submit();
+            }
+
+            submit(ec);
+
+            if (ec)
+            {
+                completion_context_->awaiting = nullptr;
+                if constexpr (usb_statistics_enabled)
+                {
+                    completion_context_->probe->on_submit_error();
+                }
+            }
+        }
+
+        void record_upcall() noexcept
+        {
+            if constexpr (usb_statistics_enabled)
+            {
+                completion_context_->probe->on_upcall();
+            }
+        }
+
+        // Submits without a completion handler, the completion is reported to the listener.
+        void submit_batched(
+            void* const data,
+            std::size_t const size,
+            detail::usb_transfer_batch_listener& listener,
+            std::size_t const index,
+            error_code& ec) noexcept
+        {
+            handle()->buffer = static_cast<unsigned char*>(data);
+            handle()->length = static_cast<int>(size);
+            completion_context_->batch = &listener;
+            completion_context_->batch_index = index;
+            if constexpr (usb_statistics_enabled)
+            {
+                completion_context_->probe->on_submit();
+            }
+
+            libusb_try(ec, &::libusb_submit_transfer, handle());
+
+            if (ec)
+            {
+                completion_context_->batch = nullptr;
+                if constexpr (usb_statistics_enabled)
+                {
+                    completion_context_->probe->on_submit_error();
+                }
+            }
         }
 
         template <typename CompletionToken>
         auto async_submit_impl(CompletionToken&& token)
+        {
+            completion_context_->is_scattered = false;
+
+            return async_submit_impl(
+                std::forward<CompletionToken>(token),
+                [handle = handle()](auto& ec) {
+                    libusb_try(ec, &::libusb_submit_transfer, handle);
+                });
+        }
+
+        template <typename BufferSequence, typename CompletionToken>
+        auto async_submit_scattered(BufferSequence const& buffers, CompletionToken&& token)
+        {
+            auto& scatter_gather = this->scatter_gather();
+            completion_context_->is_scattered = true;
+
+            // Split eagerly, the buffer sequence need not outlive this call
+            auto prepare_ec = error_code{};
+            scatter_gather.prepare(buffers, prepare_ec);
+
+            return async_submit_impl(
+                std::forward<CompletionToken>(token),
+                [&scatter_gather, prepare_ec](auto& ec) {
+                    ec = prepare_ec;
+                    if (ec) { return; }
+
+                    scatter_gather.start(ec);
+                });
+        }
+
+        // Starts an operation, submit(ec) submits the libusb transfers.
+        template <typename CompletionToken, typename SubmitFn>
+        auto async_submit_impl(CompletionToken&& token, SubmitFn&& submit)
+        {
+            if constexpr (detail::is_usb_deadline_token<std::decay_t<CompletionToken>>)
+            {
+                auto& context = *completion_context_;
+                if (context.timer_wheel == nullptr)
+                {
+                    context.timer_wheel = &asio::use_service<usb_service>(
+                                               asio::query(executor_, asio::execution::context))
+                                               .timer_wheel();
+                }
+                context.deadline.expire = &expire_deadline;
+                context.deadline.transfer = handle();
+
+                // Armed before submitting, so that the completion finds it armed
+                return async_submit_impl(
+                    std::forward<CompletionToken>(token).token,
+                    [&context, timeout = token.timeout, submit = std::forward<SubmitFn>(submit)](auto& ec) mutable {
+                        context.timer_wheel->submit(context.deadline, timeout, submit, ec);
+                    });
+            }
+            else if constexpr (std::same_as<std::decay_t<CompletionToken>, use_awaiter_t>)
+            {
+                return detail::usb_transfer_awaiter<basic_usb_transfer, std::decay_t<SubmitFn>>{
+                    *this,
+                    token,
+                    std::forward<SubmitFn>(submit),
+                };
+            }
+            else
+            {
+                return async_initiate_submit(std::forward<CompletionToken>(token), std::forward<SubmitFn>(submit));
+            }
+        }
+
+        template <typename CompletionToken, typename SubmitFn>
+        auto async_initiate_submit(CompletionToken&& token, SubmitFn&& submit)
         {
             return asio::async_initiate<CompletionToken, completion_handler_sig>(
-                [](auto completion_handler, auto const handle, auto* const context, auto const& executor) {
-                    context->handler = completion_handler_t{executor, std::move(completion_handler)};
+                [](auto completion_handler, handle_type const handle, auto* const context, auto const& executor, auto&& submit) {
+                    auto const emplace_handler = [&](auto&& handler) {
+                        if constexpr (usb_statistics_enabled)
+                        {
+                            context->handler.emplace(
+                                executor,
+                                detail::usb_timed_handler{context->probe, std::forward<decltype(handler)>(handler)});
+                        }
+                        else
+                        {
+                            context->handler.emplace(executor, std::forward<decltype(handler)>(handler));
+                        }
+                    };
+
+                    if constexpr (usb_statistics_enabled)
+                    {
+                        context->probe->on_submit();
+                    }
+
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+                    if (auto slot = asio::get_associated_cancellation_slot(completion_handler); slot.is_connected())
+                    {
+                        // Not left referring to the transfer once completed
+                        emplace_handler(detail::usb_slot_clearing_handler{slot, std::move(completion_handler)});
+                        slot.template emplace<cancellation_handler>(handle, *context);
+                    }
+                    else
+                    {
+                        emplace_handler(std::move(completion_handler));
+                    }
+#else
+                    static_cast<void>(handle);
+                    emplace_handler(std::move(completion_handler));
+#endif
 
                     auto ec = error_code{};
-                    libusb_try(ec, &::libusb_submit_transfer, handle);
+                    submit(ec);
 
                     if (ec)
                     {
                         // Error in submission
+                        if constexpr (usb_statistics_enabled)
+                        {
+                            context->probe->on_submit_error();
+                        }
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+                        context->num_completions.fetch_add(1, std::memory_order_relaxed);
+#endif
                         context->handler(ec, result_type{});
-                        context->handler.reset();
                     }
                 },
-                std::forward<CompletionToken>(token),
+                token,
                 handle(),
                 completion_context_.get(),
-                executor_);
+                executor_,
+                std::forward<SubmitFn>(submit));
+        }
+
+        [[nodiscard]] auto scatter_gather() -> detail::usb_scatter_gather&
+        {
+            auto& scatter_gather = completion_context_->scatter_gather;
+            if (scatter_gather == nullptr)
+            {
+                scatter_gather = std::make_unique<detail::usb_scatter_gather>(handle());
+            }
+            return *scatter_gather;
+        }
+
+        template <typename OtherExecutor>
+        void attach_statistics(
+            [[maybe_unused]] basic_usb_device<OtherExecutor> const& device,
+            [[maybe_unused]] std::uint8_t const endpoint)
+        {
+            if constexpr (usb_statistics_enabled)
+            {
+                // A recycled context keeps its probe, when for the same device
+                auto& probe = completion_context_->probe;
+                if (probe == nullptr || probe->device != device.statistics())
+                {
+                    probe = std::make_shared<detail::usb_transfer_probe>(device.statistics(), endpoint);
+                }
+            }
         }
 
         void check_is_constructed() const
@@ -592,63 +1350,141 @@ namespace usb_asio
         }
     };
 
+    namespace detail
+    {
+        // Submission paths of basic_usb_transfer that bypass its completion handler
+        struct usb_transfer_access
+        {
+            template <typename Transfer>
+            static void submit_batched(
+                Transfer& transfer,
+                void* const data,
+                std::size_t const size,
+                usb_transfer_batch_listener& listener,
+                std::size_t const index,
+                error_code& ec) noexcept
+            {
+                transfer.submit_batched(data, size, listener, index, ec);
+            }
+
+            template <typename Transfer, typename SubmitFn>
+            static void submit_awaited(
+                Transfer& transfer,
+                usb_transfer_awaiting<typename Transfer::result_type>& awaiting,
+                SubmitFn& submit,
+                error_code& ec) noexcept
+            {
+                transfer.submit_awaited(awaiting, submit, ec);
+            }
+
+            template <typename Transfer>
+            static void record_upcall(Transfer& transfer) noexcept
+            {
+                transfer.record_upcall();
+            }
+
+            template <typename Transfer>
+            [[nodiscard]] static auto handler_allocator(Transfer const& transfer) noexcept
+            {
+                return transfer.completion_context_->handler.get_allocator();
+            }
+        };
+    }  // namespace detail
+
     template <typename Executor = asio::any_io_executor>
     using basic_usb_out_control_transfer = basic_usb_transfer<
         usb_transfer_type::control,
-        usb_transfer_direction::out>;
+        usb_transfer_direction::out,
+        Executor>;
     using usb_out_control_transfer = basic_usb_out_control_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_in_control_transfer = basic_usb_transfer<
         usb_transfer_type::control,
-        usb_transfer_direction::in>;
+        usb_transfer_direction::in,
+        Executor>;
     using usb_in_control_transfer = basic_usb_in_control_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_out_isochronous_transfer = basic_usb_transfer<
         usb_transfer_type::isochronous,
-        usb_transfer_direction::out>;
+        usb_transfer_direction::out,
+        Executor>;
     using usb_out_isochronous_transfer = basic_usb_out_isochronous_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_in_isochronous_transfer = basic_usb_transfer<
         usb_transfer_type::isochronous,
-        usb_transfer_direction::in>;
+        usb_transfer_direction::in,
+        Executor>;
     using usb_in_isochronous_transfer = basic_usb_in_isochronous_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_out_bulk_transfer = basic_usb_transfer<
         usb_transfer_type::bulk,
-        usb_transfer_direction::out>;
+        usb_transfer_direction::out,
+        Executor>;
     using usb_out_bulk_transfer = basic_usb_out_bulk_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_in_bulk_transfer = basic_usb_transfer<
         usb_transfer_type::bulk,
-        usb_transfer_direction::in>;
+        usb_transfer_direction::in,
+        Executor>;
     using usb_in_bulk_transfer = basic_usb_in_bulk_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_out_interrupt_transfer = basic_usb_transfer<
         usb_transfer_type::interrupt,
-        usb_transfer_direction::out>;
+        usb_transfer_direction::out,
+        Executor>;
     using usb_out_interrupt_transfer = basic_usb_out_interrupt_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_in_interrupt_transfer = basic_usb_transfer<
         usb_transfer_type::interrupt,
-        usb_transfer_direction::in>;
+        usb_transfer_direction::in,
+        Executor>;
     using usb_in_interrupt_transfer = basic_usb_in_interrupt_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_out_bulk_stream_transfer = basic_usb_transfer<
         usb_transfer_type::bulk_stream,
-        usb_transfer_direction::out>;
+        usb_transfer_direction::out,
+        Executor>;
     using usb_out_bulk_stream_transfer = basic_usb_out_bulk_stream_transfer<>;
 
     template <typename Executor = asio::any_io_executor>
     using basic_usb_in_bulk_stream_transfer = basic_usb_transfer<
         usb_transfer_type::bulk_stream,
-        usb_transfer_direction::in>;
+        usb_transfer_direction::in,
+        Executor>;
     using usb_in_bulk_stream_transfer = basic_usb_in_bulk_stream_transfer<>;
 }  // namespace usb_asio
+
+#ifdef USB_ASIO_HAS_CANCELLATION_SLOT
+// The wrapper is transparent to the executor and allocator of the handler
+template <typename Handler, typename Executor>
+struct usb_asio::asio::associated_executor<usb_asio::detail::usb_slot_clearing_handler<Handler>, Executor>
+{
+    using type = typename usb_asio::asio::associated_executor<Handler, Executor>::type;
+
+    static auto get(usb_asio::detail::usb_slot_clearing_handler<Handler> const& handler, Executor const& executor = {}) noexcept
+        -> type
+    {
+        return usb_asio::asio::get_associated_executor(handler.handler(), executor);
+    }
+};
+
+template <typename Handler, typename Alloc>
+struct usb_asio::asio::associated_allocator<usb_asio::detail::usb_slot_clearing_handler<Handler>, Alloc>
+{
+    using type = typename usb_asio::asio::associated_allocator<Handler, Alloc>::type;
+
+    static auto get(usb_asio::detail::usb_slot_clearing_handler<Handler> const& handler, Alloc const& alloc = {}) noexcept
+        -> type
+    {
+        return usb_asio::asio::get_associated_allocator(handler.handler(), alloc);
+    }
+};
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    // Completion token making a transfer operation return an awaitable,
+    // for C++20 coroutines other than asio::awaitable (whose promise only awaits asio operations).
+    // The awaiter lives in the coroutine frame, and the completion resumes the coroutine on
+    // the transfer's executor, without allocating a completion handler. With an io_context executor,
+    // the resumption is posted in the recycled handler memory of the transfer, without allocating.
+    // Errors are thrown as system_error, or stored when the token is given an error_code:
+    //   auto const transferred = co_await transfer.async_read_some(buffer, use_awaiter(ec));
+    struct use_awaiter_t
+    {
+        error_code* ec = nullptr;
+
+        [[nodiscard]] auto operator()(error_code& ec) const noexcept -> use_awaiter_t
+        {
+            return use_awaiter_t{&ec};
+        }
+    };
+
+    inline constexpr auto use_awaiter = use_awaiter_t{};
+
+    namespace detail
+    {
+        template <typename Transfer, typename SubmitFn>
+        class usb_transfer_awaiter final : public usb_transfer_awaiting<typename Transfer::result_type>
+        {
+          public:
+            using result_type = typename Transfer::result_type;
+
+            usb_transfer_awaiter(Transfer& transfer, use_awaiter_t const token, SubmitFn submit)
+              : transfer_{&transfer}
+              , token_{token}
+              , submit_{std::move(submit)} { }
+
+            usb_transfer_awaiter(usb_transfer_awaiter const&) = delete;
+
+            [[nodiscard]] auto await_ready() const noexcept -> bool
+            {
+                return false;
+            }
+
+            auto await_suspend(std::coroutine_handle<> const coroutine) noexcept -> bool
+            {
+                coroutine_ = coroutine;
+                work_executor_.emplace(transfer_->get_executor());
+                alloc_.emplace(usb_transfer_access::handler_allocator(*transfer_));
+
+                usb_transfer_access::submit_awaited(*transfer_, *this, submit_, ec_);
+                if (ec_)
+                {
+                    // Error in submission, resume right away
+                    work_executor_.reset();
+                    alloc_.reset();
+                    return false;
+                }
+                return true;
+            }
+
+            auto await_resume() -> result_type
+            {
+                usb_transfer_access::record_upcall(*transfer_);
+
+                if (token_.ec != nullptr)
+                {
+                    *token_.ec = ec_;
+                }
+                else if (ec_)
+                {
+                    throw system_error{ec_};
+                }
+                return result_;
+            }
+
+            void on_transfer_complete(
+                usb_completion_dispatch const dispatch,
+                error_code const ec,
+                result_type const result) noexcept override
+            {
+                ec_ = ec;
+                result_ = result;
+
+                // The coroutine may destroy this awaiter as soon as it resumes
+                auto const work_executor = std::move(*work_executor_);
+                auto const coroutine = coroutine_;
+                auto resume = bind_handler(std::move(*alloc_), [coroutine]() { coroutine.resume(); });
+                work_executor.complete(dispatch, std::move(resume));
+            }
+
+            auto operator=(usb_transfer_awaiter const&) = delete;
+
+          private:
+            Transfer* transfer_;
+            use_awaiter_t token_;
+            SubmitFn submit_;
+            std::coroutine_handle<> coroutine_ = {};
+            std::optional<tracked_completion_executor<typename Transfer::executor_type>> work_executor_ = std::nullopt;
+            std::optional<handler_allocator<void>> alloc_ = std::nullopt;
+            error_code ec_ = {};
+            result_type result_ = {};
+        };
+    }  // namespace detail
+}  // namespace usb_asio
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "usb_asio/asio.hpp"
+#include "usb_asio/completion_handler.hpp"
+#include "usb_asio/error.hpp"
+#include "usb_asio/usb_transfer.hpp"
+
+namespace usb_asio
+{
+    struct usb_batch_transfer_result
+    {
+        std::size_t transferred;
+        error_code ec;
+    };
+
+    struct usb_transfer_batch_result
+    {
+        // Number of submitted transfers. When less than the size of the batch,
+        // the submission of the transfer at this index failed with submit_ec,
+        // and the transfers after it were not submitted.
+        std::size_t submitted = 0;
+        error_code submit_ec = {};
+        // Results of the submitted transfers, in batch order.
+        std::vector<usb_batch_transfer_result> transfers = {};
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        concept usb_batch_transfer = (T::transfer_type == usb_transfer_type::bulk)
+                                     || (T::transfer_type == usb_transfer_type::interrupt)
+                                     || (T::transfer_type == usb_transfer_type::bulk_stream);
+
+        template <typename T>
+        using usb_batch_buffer_t = std::conditional_t<
+            T::transfer_direction == usb_transfer_direction::in,
+            asio::mutable_buffer,
+            asio::const_buffer>;
+
+        // Bookkeeping of a batch, shared by its transfers.
+        // Deletes itself after handing the result over to the handler.
+        template <typename Executor>
+        class usb_transfer_batch_op final : public usb_transfer_batch_listener
+        {
+          public:
+            template <typename Handler>
+            usb_transfer_batch_op(
+                Executor const& executor,
+                Handler&& handler,
+                usb_completion_dispatch const dispatch,
+                std::size_t const size)
+              : dispatch_{dispatch}
+            {
+                result_.transfers.resize(size);
+                handler_.emplace(executor, std::forward<Handler>(handler));
+            }
+
+            template <typename TransferRange, typename BufferRange>
+            void start(TransferRange& transfers, BufferRange const& buffers) noexcept
+            {
+                auto const size = result_.transfers.size();
+                // Completions arriving during the submission must not finish the batch
+                pending_.store(size + 1, std::memory_order_relaxed);
+
+                auto buffer = std::ranges::begin(buffers);
+                for (auto& transfer : transfers)
+                {
+                    auto ec = error_code{};
+                    auto const data = usb_batch_buffer_t<std::ranges::range_value_t<TransferRange>>{*buffer++};
+                    usb_transfer_access::submit_batched(
+                        transfer,
+                        const_cast<void*>(static_cast<void const*>(data.data())),
+                        data.size(),
+                        *this,
+                        result_.submitted,
+                        ec);
+                    if (ec)
+                    {
+                        result_.submit_ec = ec;
+                        break;
+                    }
+                    ++result_.submitted;
+                }
+
+                // Finishing here, on the initiating thread, must not invoke the handler inline
+                release(size - result_.submitted + 1, usb_completion_dispatch::post);
+            }
+
+            void on_transfer_complete(
+                std::size_t const index,
+                error_code const ec,
+                std::size_t const transferred) noexcept override
+            {
+                result_.transfers[index] = usb_batch_transfer_result{transferred, ec};
+                release(1, dispatch_);
+            }
+
+          private:
+            std::atomic<std::size_t> pending_ = 0;
+            usb_transfer_batch_result result_;
+            usb_completion_dispatch dispatch_;
+            completion_handler<Executor, error_code, usb_transfer_batch_result> handler_;
+
+            void release(std::size_t const count, usb_completion_dispatch const dispatch) noexcept
+            {
+                if (pending_.fetch_sub(count, std::memory_order_acq_rel) == count)
+                {
+                    finish(dispatch);
+                }
+            }
+
+            void finish(usb_completion_dispatch const dispatch) noexcept
+            {
+                result_.transfers.resize(result_.submitted);
+
+                auto ec = result_.submit_ec;
+                if (!ec)
+                {
+                    for (auto const& transfer_result : result_.transfers)
+                    {
+                        if (transfer_result.ec)
+                        {
+                            ec = transfer_result.ec;
+                            break;
+                        }
+                    }
+                }
+
+                handler_(dispatch, ec, std::move(result_));
+                delete this;
+            }
+        };
+    }  // namespace detail
+
+    // Submits a batch of transfers with one completion handler, which is called
+    // after all the submitted transfers complete. The transfers are submitted in order,
+    // transfers[i] reading or writing buffers[i], and must not have an operation in flight.
+    // Their completions are collected on the event handling thread, without posting a handler each.
+    // The error code is the submission error, or else the first error of a transfer;
+    // the result reports both precisely. The handler is posted or dispatched
+    // according to the completion_dispatch of the first transfer.
+    // Mismatched sizes of the ranges fail with usb_errc::invalid_param, submitting nothing.
+    // clang-format off
+    template <
+        std::ranges::forward_range TransferRange,
+        std::ranges::forward_range BufferRange,
+        typename CompletionToken = asio::default_completion_token_t<
+            typename std::ranges::range_value_t<TransferRange>::executor_type>>
+    auto async_submit_batch(TransferRange& transfers, BufferRange const& buffers, CompletionToken&& token = {})
+    requires detail::usb_batch_transfer<std::ranges::range_value_t<TransferRange>>
+        && std::convertible_to<
+            std::ranges::range_reference_t<BufferRange const>,
+            detail::usb_batch_buffer_t<std::ranges::range_value_t<TransferRange>>>
+    // clang-format on
+    {
+        using transfer_type = std::ranges::range_value_t<TransferRange>;
+        using executor_type = typename transfer_type::executor_type;
+        using op_type = detail::usb_transfer_batch_op<executor_type>;
+
+        return asio::async_initiate<CompletionToken, void(error_code, usb_transfer_batch_result)>(
+            [](auto completion_handler, TransferRange& transfers, BufferRange const& buffers) {
+                auto const size = static_cast<std::size_t>(std::ranges::distance(transfers));
+                if (size == 0 || static_cast<std::size_t>(std::ranges::distance(buffers)) != size)
+                {
+                    // Nothing to submit, completes on the handler's associated executor
+                    // (by default that of the transfers, which is kept busy until then)
+                    auto result = usb_transfer_batch_result{};
+                    auto const alloc = asio::get_associated_allocator(completion_handler);
+                    if (size == 0)
+                    {
+                        auto const executor = asio::get_associated_executor(completion_handler);
+                        asio::post(
+                            executor,
+                            detail::bind_handler(alloc, std::move(completion_handler), error_code{}, std::move(result)));
+                    }
+                    else
+                    {
+                        result.submit_ec = make_error_code(usb_errc::invalid_param);
+                        auto const ec = result.submit_ec;
+                        auto const io_executor = std::ranges::begin(transfers)->get_executor();
+                        auto const executor = asio::get_associated_executor(completion_handler, io_executor);
+                        asio::post(
+                            io_executor,
+                            asio::bind_executor(
+                                executor,
+                                detail::bind_handler(alloc, std::move(completion_handler), ec, std::move(result))));
+                    }
+                    return;
+                }
+
+                auto& first = *std::ranges::begin(transfers);
+                auto op = std::make_unique<op_type>(
+                    first.get_executor(),
+                    std::move(completion_handler),
+                    first.completion_dispatch(),
+                    size);
+                op.release()->start(transfers, buffers);
+            },
+            token,
+            std::ref(transfers),
+            std::cref(buffers));
+    }
+}  // namespace usb_asio
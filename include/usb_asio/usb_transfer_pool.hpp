@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/error.hpp"
+#include "usb_asio/flags.hpp"
+#include "usb_asio/libusb_ptr.hpp"
+
+namespace usb_asio
+{
+    template <
+        usb_transfer_type transfer_type_,
+        usb_transfer_direction transfer_direction_,
+        typename Executor>
+    class basic_usb_transfer;
+
+    namespace detail
+    {
+        // Transfers with equal keys can use each other's libusb transfer and completion context
+        struct usb_transfer_pool_key
+        {
+            ::libusb_device_handle* device = nullptr;
+            std::uint8_t endpoint = 0;
+            usb_transfer_type type = usb_transfer_type::control;
+            int num_iso_packets = 0;
+            // Destroys the completion context, unique to the type of the context
+            void (*destroy_context)(void*) noexcept = nullptr;
+
+            [[nodiscard]] auto operator==(usb_transfer_pool_key const&) const noexcept -> bool = default;
+        };
+
+        struct usb_transfer_context_deleter
+        {
+            void (*destroy)(void*) noexcept = nullptr;
+
+            void operator()(void* const context) const noexcept
+            {
+                destroy(context);
+            }
+        };
+
+        using usb_transfer_context_ptr = std::unique_ptr<void, usb_transfer_context_deleter>;
+
+        class usb_transfer_pool_state;
+
+        // What a transfer allocates, and the pool to give it back to
+        struct usb_transfer_resources
+        {
+            libusb_ptr<::libusb_transfer, &::libusb_free_transfer> handle = nullptr;
+            // Null when not recycled
+            usb_transfer_context_ptr context = nullptr;
+            std::shared_ptr<usb_transfer_pool_state> pool = nullptr;
+            usb_transfer_pool_key key = {};
+        };
+
+        class usb_transfer_pool_state : public std::enable_shared_from_this<usb_transfer_pool_state>
+        {
+          public:
+            explicit usb_transfer_pool_state(std::size_t const max_idle_per_key) noexcept
+              : max_idle_per_key_{max_idle_per_key} { }
+
+            [[nodiscard]] auto acquire(usb_transfer_pool_key const& key) -> usb_transfer_resources
+            {
+                auto resources = usb_transfer_resources{};
+                {
+                    auto const lock = std::lock_guard{mutex_};
+                    if (auto const bucket = find(key); bucket != buckets_.end() && !bucket->idle.empty())
+                    {
+                        auto& idle = bucket->idle.back();
+                        resources.handle = std::move(idle.handle);
+                        resources.context = std::move(idle.context);
+                        bucket->idle.pop_back();
+                    }
+                }
+
+                if (resources.handle == nullptr)
+                {
+                    resources.handle.reset(::libusb_alloc_transfer(key.num_iso_packets));
+                }
+                resources.pool = shared_from_this();
+                resources.key = key;
+                return resources;
+            }
+
+            // Keeps the transfer for the next acquire of the key, unless max_idle_per_key are idle.
+            void recycle(usb_transfer_resources&& resources) noexcept
+            {
+                auto const lock = std::lock_guard{mutex_};
+
+                auto bucket = find(resources.key);
+                if (bucket == buckets_.end())
+                {
+                    try
+                    {
+                        bucket = buckets_.insert(buckets_.end(), pool_bucket{resources.key});
+                        bucket->idle.reserve(max_idle_per_key_);
+                    }
+                    catch (...)
+                    {
+                        // Freed instead
+                        return;
+                    }
+                }
+
+                if (bucket->idle.size() < max_idle_per_key_)
+                {
+                    bucket->idle.push_back(idle_transfer{std::move(resources.handle), std::move(resources.context)});
+                }
+            }
+
+            void clear() noexcept
+            {
+                auto buckets = std::vector<pool_bucket>{};
+                {
+                    auto const lock = std::lock_guard{mutex_};
+                    buckets.swap(buckets_);
+                }
+            }
+
+            [[nodiscard]] auto num_idle() const -> std::size_t
+            {
+                auto const lock = std::lock_guard{mutex_};
+
+                auto num_idle = std::size_t{0};
+                for (auto const& bucket : buckets_)
+                {
+                    num_idle += bucket.idle.size();
+                }
+                return num_idle;
+            }
+
+          private:
+            struct idle_transfer
+            {
+                libusb_ptr<::libusb_transfer, &::libusb_free_transfer> handle;
+                usb_transfer_context_ptr context;
+            };
+
+            struct pool_bucket
+            {
+                usb_transfer_pool_key key;
+                std::vector<idle_transfer> idle = {};
+            };
+
+            std::size_t max_idle_per_key_;
+            mutable std::mutex mutex_;
+            // Few keys, a device has at most 32 endpoints
+            std::vector<pool_bucket> buckets_;
+
+            [[nodiscard]] auto find(usb_transfer_pool_key const& key) noexcept -> typename std::vector<pool_bucket>::iterator
+            {
+                return std::ranges::find(buckets_, key, &pool_bucket::key);
+            }
+        };
+    }  // namespace detail
+
+    // Recycles the libusb transfers and completion contexts of the transfers constructed from it,
+    // keyed by device, endpoint and transfer type (and number of packets, for isochronous transfers).
+    // When such a transfer is destroyed, its allocations are kept in the pool, so that constructing
+    // the next transfer of the same key does not allocate. The pool may be destroyed before its transfers,
+    // and may be shared between threads.
+    class usb_transfer_pool
+    {
+      public:
+        static constexpr auto default_max_idle_per_key = std::size_t{64};
+
+        explicit usb_transfer_pool(std::size_t const max_idle_per_key = default_max_idle_per_key)
+          : state_{std::make_shared<detail::usb_transfer_pool_state>(max_idle_per_key)} { }
+
+        // Frees the idle transfers.
+        void clear() noexcept
+        {
+            state_->clear();
+        }
+
+        [[nodiscard]] auto num_idle() const -> std::size_t
+        {
+            return state_->num_idle();
+        }
+
+      private:
+        template <usb_transfer_type, usb_transfer_direction, typename>
+        friend class basic_usb_transfer;
+
+        std::shared_ptr<detail::usb_transfer_pool_state> state_;
+
+        [[nodiscard]] auto acquire(detail::usb_transfer_pool_key const& key) -> detail::usb_transfer_resources
+        {
+            return state_->acquire(key);
+        }
+    };
+}  // namespace usb_asio
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <libusb.h>
+#include "usb_asio/flags.hpp"
+
+// Control of the simulated USB bus of the usb_asio_simulation library.
+// The library implements the part of the libusb API used by usb_asio in process,
+// and is linked instead of libusb, so that usb_asio can be benchmarked and tested
+// on machines without USB hardware. Any libusb context sees the simulated devices
+// in its device lists and hotplug notifications.
+namespace usb_asio::simulation
+{
+    struct simulated_endpoint
+    {
+        // Including the direction bit.
+        std::uint8_t address;
+        usb_transfer_type type = usb_transfer_type::bulk;
+        std::uint16_t max_packet_size = 512;
+        std::uint8_t interval = 0;
+    };
+
+    struct simulated_device_config
+    {
+        std::uint16_t vendor_id = 0xFFFFu;
+        std::uint16_t product_id = 0x0001u;
+        std::uint8_t bus_number = 1;
+        // Assigned by the bus when 0.
+        std::uint8_t device_address = 0;
+        usb_speed speed = usb_speed::high;
+        // The endpoints of interface 0, alt setting 0, configuration 1.
+        std::vector<simulated_endpoint> endpoints = {
+            {.address = 0x81u},
+            {.address = 0x01u},
+        };
+        // Time from the submission of a transfer to its completion.
+        std::chrono::nanoseconds latency = std::chrono::nanoseconds{0};
+        // Time the blocking requests (set_configuration, clear_halt, reset_device,
+        // set_interface_alt_setting, release_interface) block the calling thread.
+        std::chrono::nanoseconds blocking_request_duration = std::chrono::nanoseconds{0};
+        // Data rate of the device, 0 for unlimited.
+        // Transfers of the device are transmitted one after another at this rate.
+        double bytes_per_second = 0.0;
+        // Probability of a transfer failing with error_status.
+        // The failures are pseudo-random, but deterministic for a given seed.
+        double error_rate = 0.0;
+        ::libusb_transfer_status error_status = ::LIBUSB_TRANSFER_ERROR;
+        std::uint64_t seed = 1;
+        // IN endpoints receive the data written to the OUT endpoint with the same number.
+        // IN transfers then wait (until their timeout) for data to be written.
+        bool loopback = false;
+        // Bytes received by an IN transfer when not looped back, 0 for the full length.
+        // A smaller value simulates short packets.
+        std::size_t in_transfer_size = 0;
+        // Whether libusb_dev_mem_alloc succeeds for the device.
+        bool dma_memory = true;
+    };
+
+    struct simulated_device_stats
+    {
+        std::uint64_t submitted = 0;
+        std::uint64_t completed = 0;
+        std::uint64_t failed = 0;
+        std::uint64_t cancelled = 0;
+        std::uint64_t bytes_in = 0;
+        std::uint64_t bytes_out = 0;
+        // Blocking requests started while another one of the device was running
+        std::uint64_t overlapping_blocking_requests = 0;
+    };
+
+    using simulated_device_id = std::uint32_t;
+
+    // Connects a device, reported to hotplug callbacks as an arrival.
+    [[nodiscard]] auto add_device(simulated_device_config const& config) -> simulated_device_id;
+
+    // Disconnects a device. Its pending transfers complete with LIBUSB_TRANSFER_NO_DEVICE
+    // and further submissions fail with LIBUSB_ERROR_NO_DEVICE.
+    void remove_device(simulated_device_id id);
+
+    [[nodiscard]] auto device_stats(simulated_device_id id) -> simulated_device_stats;
+
+    // CPU time spent in libusb event handling (the libusb_handle_events functions,
+    // including the completion callbacks), summed over the threads handling events.
+    [[nodiscard]] auto event_handling_cpu_time() -> std::chrono::nanoseconds;
+
+    // Disconnects all devices.
+    void reset();
+}  // namespace usb_asio::simulation
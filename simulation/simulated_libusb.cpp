@@ -0,0 +1,1341 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libusb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "usb_asio/simulation.hpp"
+
+namespace usb_asio::simulation
+{
+    namespace
+    {
+        using clock = std::chrono::steady_clock;
+
+        constexpr auto default_event_timeout = std::chrono::seconds{60};
+        constexpr auto page_size = std::size_t{4096};
+
+        struct device_state
+        {
+            simulated_device_id id;
+            simulated_device_config config;
+
+            std::mutex mutex;
+            bool removed = false;
+            clock::time_point busy_until = {};
+            std::mt19937_64 rng;
+            std::uint8_t fill_value = 0;
+            simulated_device_stats stats;
+            std::size_t running_blocking_requests = 0;
+            // Looped back data and the IN transfers waiting for it, by endpoint number
+            std::array<std::deque<std::byte>, 16> loopback_data;
+            std::array<std::deque<::libusb_transfer*>, 16> waiting_transfers;
+
+            device_state(simulated_device_id const id, simulated_device_config const& config)
+              : id{id}
+              , config{config}
+              , rng{config.seed} { }
+
+            [[nodiscard]] auto find_endpoint(std::uint8_t const address) const noexcept
+                -> simulated_endpoint const*
+            {
+                auto const iter = std::ranges::find(config.endpoints, address, &simulated_endpoint::address);
+                return iter != config.endpoints.end() ? &*iter : nullptr;
+            }
+        };
+
+        enum class transfer_state
+        {
+            idle,
+            queued,
+            waiting,
+        };
+
+        // Stored in front of each libusb_transfer
+        struct transfer_header
+        {
+            std::uint32_t stream_id = 0;
+            transfer_state state = transfer_state::idle;
+            // Bumped when the transfer is requeued, to skip the stale queue entries
+            std::uint64_t generation = 0;
+        };
+
+        constexpr auto transfer_header_size =
+            (sizeof(transfer_header) + alignof(::libusb_transfer) - 1u)
+            / alignof(::libusb_transfer) * alignof(::libusb_transfer);
+
+        [[nodiscard]] auto header_of(::libusb_transfer* const transfer) noexcept -> transfer_header&
+        {
+            return *std::launder(reinterpret_cast<transfer_header*>(
+                reinterpret_cast<std::byte*>(transfer) - transfer_header_size));
+        }
+
+        struct queue_entry
+        {
+            clock::time_point due;
+            std::uint64_t sequence;
+            std::uint64_t generation;
+            ::libusb_transfer* transfer;
+
+            // For a min-heap
+            [[nodiscard]] friend auto operator<(queue_entry const& lhs, queue_entry const& rhs) noexcept -> bool
+            {
+                if (lhs.due != rhs.due) { return lhs.due > rhs.due; }
+                return lhs.sequence > rhs.sequence;
+            }
+        };
+
+        struct hotplug_callback
+        {
+            ::libusb_hotplug_callback_handle handle;
+            int events;
+            int vendor_id;
+            int product_id;
+            int device_class;
+            ::libusb_hotplug_callback_fn fn;
+            void* user_data;
+        };
+
+        struct hotplug_notification
+        {
+            ::libusb_device* device;
+            ::libusb_hotplug_event event;
+        };
+    }  // namespace
+}  // namespace usb_asio::simulation
+
+struct libusb_context
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<usb_asio::simulation::queue_entry> queue;
+    std::vector<::libusb_transfer*> ready;
+    std::uint64_t next_sequence = 0;
+    bool interrupted = false;
+    // Readable when a completion is due, like the usbfs fd of a device:
+    // the event fd for what is due right away, the timer fd for later
+    int event_fd = -1;
+    int timer_fd = -1;
+    // Whether the fds are watched, otherwise they are not signalled
+    bool polled = false;
+    std::array<::libusb_pollfd, 2> pollfds = {};
+    std::vector<usb_asio::simulation::hotplug_callback> hotplug_callbacks;
+    std::vector<usb_asio::simulation::hotplug_notification> hotplug_notifications;
+    ::libusb_hotplug_callback_handle next_hotplug_handle = 1;
+
+    // Guarded by the bus mutex
+    std::vector<::libusb_device*> devices;
+};
+
+struct libusb_device
+{
+    std::atomic<int> refs = 1;
+    ::libusb_context* context;
+    std::shared_ptr<usb_asio::simulation::device_state> state;
+};
+
+struct libusb_device_handle
+{
+    ::libusb_device* device;
+};
+
+namespace usb_asio::simulation
+{
+    namespace
+    {
+        struct bus
+        {
+            std::mutex mutex;
+            std::vector<::libusb_context*> contexts;
+            std::vector<std::shared_ptr<device_state>> devices;
+            simulated_device_id next_id = 1;
+            std::uint8_t next_address = 1;
+            ::libusb_context* default_context = nullptr;
+        };
+
+        [[nodiscard]] auto the_bus() -> bus&
+        {
+            static auto instance = bus{};
+            return instance;
+        }
+
+        [[nodiscard]] auto resolve(::libusb_context* const context) noexcept -> ::libusb_context*
+        {
+            return context != nullptr ? context : the_bus().default_context;
+        }
+
+        [[nodiscard]] auto new_device(::libusb_context* const context, std::shared_ptr<device_state> state)
+            -> ::libusb_device*
+        {
+            auto const device = new ::libusb_device{};
+            device->context = context;
+            device->state = std::move(state);
+            return device;
+        }
+
+        // Makes the fds readable at the given time. Requires the context lock.
+        void arm_timer(::libusb_context& context, clock::time_point const due) noexcept
+        {
+            if (!context.polled) { return; }
+
+            if (due <= clock::now())
+            {
+                auto const one = std::uint64_t{1};
+                [[maybe_unused]] auto const result = ::write(context.event_fd, &one, sizeof(one));
+                return;
+            }
+
+            // steady_clock is CLOCK_MONOTONIC
+            auto const since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch());
+            auto spec = ::itimerspec{};
+            spec.it_value.tv_sec = static_cast<decltype(spec.it_value.tv_sec)>(since_epoch.count() / 1'000'000'000);
+            spec.it_value.tv_nsec = static_cast<decltype(spec.it_value.tv_nsec)>(since_epoch.count() % 1'000'000'000);
+            ::timerfd_settime(context.timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        }
+
+        // Requires the context lock
+        void signal(::libusb_context& context, clock::time_point const due = {}) noexcept
+        {
+            context.cv.notify_one();
+            arm_timer(context, due);
+        }
+
+        // Requires the context lock
+        void enqueue(
+            ::libusb_context& context,
+            ::libusb_transfer* const transfer,
+            clock::time_point const due)
+        {
+            auto& header = header_of(transfer);
+            header.state = transfer_state::queued;
+
+            auto const was_earliest = context.queue.empty() || due < context.queue.front().due;
+            context.queue.push_back(queue_entry{due, context.next_sequence++, ++header.generation, transfer});
+            std::push_heap(context.queue.begin(), context.queue.end());
+
+            if (was_earliest) { signal(context, due); }
+        }
+
+        // Drops the entries of transfers that were requeued since. Requires the context lock.
+        void drop_stale(::libusb_context& context)
+        {
+            while (!context.queue.empty())
+            {
+                auto const& entry = context.queue.front();
+                if (header_of(entry.transfer).generation == entry.generation
+                    && header_of(entry.transfer).state != transfer_state::idle)
+                {
+                    return;
+                }
+
+                std::pop_heap(context.queue.begin(), context.queue.end());
+                context.queue.pop_back();
+            }
+        }
+
+        // Blocks the calling thread like a device request would
+        void simulate_blocking_request(::libusb_device_handle const& handle)
+        {
+            auto& state = *handle.device->state;
+            {
+                auto const lock = std::lock_guard{state.mutex};
+                if (state.running_blocking_requests++ != 0) { ++state.stats.overlapping_blocking_requests; }
+            }
+
+            std::this_thread::sleep_for(state.config.blocking_request_duration);
+
+            auto const lock = std::lock_guard{state.mutex};
+            --state.running_blocking_requests;
+        }
+
+        void fill(device_state& state, unsigned char* const data, std::size_t const size)
+        {
+            std::memset(data, state.fill_value++, size);
+        }
+
+        // Completion time of a transfer of the given size. Requires the device lock.
+        [[nodiscard]] auto schedule(device_state& state, std::size_t const size) -> clock::time_point
+        {
+            auto const now = clock::now();
+            auto transmission = clock::duration{0};
+            if (state.config.bytes_per_second > 0.0)
+            {
+                transmission = std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>{static_cast<double>(size) / state.config.bytes_per_second});
+            }
+
+            state.busy_until = std::max(now, state.busy_until) + transmission;
+            return state.busy_until + state.config.latency;
+        }
+
+        // Hands looped back data to the waiting IN transfers. Requires the device lock.
+        void serve_waiting(device_state& state, std::size_t const endpoint_number)
+        {
+            auto& data = state.loopback_data[endpoint_number];
+            auto& waiting = state.waiting_transfers[endpoint_number];
+
+            while (!data.empty() && !waiting.empty())
+            {
+                auto const transfer = waiting.front();
+                waiting.pop_front();
+
+                auto const size = std::min(data.size(), static_cast<std::size_t>(transfer->length));
+                std::copy_n(data.begin(), size, reinterpret_cast<std::byte*>(transfer->buffer));
+                data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(size));
+
+                transfer->actual_length = static_cast<int>(size);
+                transfer->status = ::LIBUSB_TRANSFER_COMPLETED;
+                state.stats.bytes_in += size;
+
+                auto& context = *transfer->dev_handle->device->context;
+                auto const due = schedule(state, size);
+                auto const lock = std::lock_guard{context.mutex};
+                enqueue(context, transfer, due);
+            }
+        }
+
+        // Fails the pending transfers of a removed device. Requires the device lock.
+        void fail_pending(device_state& state)
+        {
+            for (auto& waiting : state.waiting_transfers)
+            {
+                for (auto const transfer : waiting)
+                {
+                    transfer->status = ::LIBUSB_TRANSFER_NO_DEVICE;
+                    auto& context = *transfer->dev_handle->device->context;
+                    auto const lock = std::lock_guard{context.mutex};
+                    enqueue(context, transfer, clock::now());
+                }
+                waiting.clear();
+            }
+        }
+
+        // Returns whether the transfer completes right away.
+        [[nodiscard]] auto simulate_data(device_state& state, ::libusb_transfer& transfer) -> bool
+        {
+            auto const in = (transfer.endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+            auto const length = static_cast<std::size_t>(transfer.length);
+
+            switch (transfer.type)
+            {
+                case ::LIBUSB_TRANSFER_TYPE_CONTROL:
+                {
+                    auto const setup = transfer.buffer;
+                    auto const size = std::min(
+                        static_cast<std::size_t>(setup[6] | (setup[7] << 8u)),
+                        length - LIBUSB_CONTROL_SETUP_SIZE);
+                    if ((setup[0] & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+                    {
+                        fill(state, setup + LIBUSB_CONTROL_SETUP_SIZE, size);
+                        state.stats.bytes_in += size;
+                    }
+                    else
+                    {
+                        state.stats.bytes_out += size;
+                    }
+                    transfer.actual_length = static_cast<int>(size);
+                    return true;
+                }
+                case ::LIBUSB_TRANSFER_TYPE_ISOCHRONOUS:
+                {
+                    for (auto& packet : std::span{transfer.iso_packet_desc, static_cast<std::size_t>(transfer.num_iso_packets)})
+                    {
+                        packet.actual_length = packet.length;
+                        packet.status = ::LIBUSB_TRANSFER_COMPLETED;
+                    }
+                    if (in) { fill(state, transfer.buffer, length); }
+                    (in ? state.stats.bytes_in : state.stats.bytes_out) += length;
+                    transfer.actual_length = static_cast<int>(length);
+                    return true;
+                }
+                default:
+                    break;
+            }
+
+            auto const endpoint_number = transfer.endpoint & LIBUSB_ENDPOINT_ADDRESS_MASK;
+
+            if (!in)
+            {
+                if (state.config.loopback)
+                {
+                    auto const data = reinterpret_cast<std::byte const*>(transfer.buffer);
+                    state.loopback_data[endpoint_number].insert(
+                        state.loopback_data[endpoint_number].end(),
+                        data,
+                        data + length);
+                }
+                state.stats.bytes_out += length;
+                transfer.actual_length = static_cast<int>(length);
+                return true;
+            }
+
+            if (state.config.loopback)
+            {
+                auto& data = state.loopback_data[endpoint_number];
+                if (data.empty())
+                {
+                    header_of(&transfer).state = transfer_state::waiting;
+                    state.waiting_transfers[endpoint_number].push_back(&transfer);
+                    return false;
+                }
+
+                auto const size = std::min(data.size(), length);
+                std::copy_n(data.begin(), size, reinterpret_cast<std::byte*>(transfer.buffer));
+                data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(size));
+                state.stats.bytes_in += size;
+                transfer.actual_length = static_cast<int>(size);
+                return true;
+            }
+
+            auto const size = state.config.in_transfer_size != 0
+                                  ? std::min(state.config.in_transfer_size, length)
+                                  : length;
+            fill(state, transfer.buffer, size);
+            state.stats.bytes_in += size;
+            transfer.actual_length = static_cast<int>(size);
+            return true;
+        }
+
+        [[nodiscard]] auto max_packet_size(::libusb_device* const device, unsigned char const endpoint) -> int
+        {
+            auto const descriptor = device->state->find_endpoint(endpoint);
+            if (descriptor == nullptr) { return ::LIBUSB_ERROR_NOT_FOUND; }
+
+            return descriptor->max_packet_size;
+        }
+
+        [[nodiscard]] auto make_config_descriptor(device_state const& state) -> ::libusb_config_descriptor*
+        {
+            // One block, freed by libusb_free_config_descriptor
+            struct layout
+            {
+                ::libusb_config_descriptor config;
+                ::libusb_interface interface;
+                ::libusb_interface_descriptor alt_setting;
+                ::libusb_endpoint_descriptor endpoints[1];
+            };
+
+            auto const num_endpoints = state.config.endpoints.size();
+            auto const block = static_cast<layout*>(std::calloc(
+                1,
+                sizeof(layout) + std::max(num_endpoints, std::size_t{1}) * sizeof(::libusb_endpoint_descriptor)));
+            if (block == nullptr) { return nullptr; }
+
+            for (auto index = std::size_t{0}; index < num_endpoints; ++index)
+            {
+                auto const& endpoint = state.config.endpoints[index];
+                auto& descriptor = block->endpoints[index];
+                descriptor.bLength = LIBUSB_DT_ENDPOINT_SIZE;
+                descriptor.bDescriptorType = ::LIBUSB_DT_ENDPOINT;
+                descriptor.bEndpointAddress = endpoint.address;
+                descriptor.bmAttributes = static_cast<std::uint8_t>(endpoint.type);
+                descriptor.wMaxPacketSize = endpoint.max_packet_size;
+                descriptor.bInterval = endpoint.interval;
+            }
+
+            block->alt_setting.bLength = LIBUSB_DT_INTERFACE_SIZE;
+            block->alt_setting.bDescriptorType = ::LIBUSB_DT_INTERFACE;
+            block->alt_setting.bNumEndpoints = static_cast<std::uint8_t>(num_endpoints);
+            block->alt_setting.bInterfaceClass = ::LIBUSB_CLASS_VENDOR_SPEC;
+            block->alt_setting.endpoint = block->endpoints;
+
+            block->interface.altsetting = &block->alt_setting;
+            block->interface.num_altsetting = 1;
+
+            block->config.bLength = LIBUSB_DT_CONFIG_SIZE;
+            block->config.bDescriptorType = ::LIBUSB_DT_CONFIG;
+            block->config.bNumInterfaces = 1;
+            block->config.bConfigurationValue = 1;
+            block->config.bmAttributes = 0x80u;
+            block->config.interface = &block->interface;
+
+            return &block->config;
+        }
+
+        void notify_hotplug(::libusb_context& context, ::libusb_device* const device, ::libusb_hotplug_event const event)
+        {
+            ::libusb_ref_device(device);
+
+            auto const lock = std::lock_guard{context.mutex};
+            context.hotplug_notifications.push_back(hotplug_notification{device, event});
+            signal(context);
+        }
+
+        [[nodiscard]] auto matches(hotplug_callback const& callback, ::libusb_device* const device, ::libusb_hotplug_event const event) noexcept -> bool
+        {
+            auto const& config = device->state->config;
+            return (callback.events & event) != 0
+                   && (callback.vendor_id == LIBUSB_HOTPLUG_MATCH_ANY || callback.vendor_id == config.vendor_id)
+                   && (callback.product_id == LIBUSB_HOTPLUG_MATCH_ANY || callback.product_id == config.product_id)
+                   && (callback.device_class == LIBUSB_HOTPLUG_MATCH_ANY || callback.device_class == ::LIBUSB_CLASS_PER_INTERFACE);
+        }
+
+        void deregister_hotplug(::libusb_context& context, ::libusb_hotplug_callback_handle const handle)
+        {
+            auto const lock = std::lock_guard{context.mutex};
+            std::erase_if(context.hotplug_callbacks, [&](auto const& callback) {
+                return callback.handle == handle;
+            });
+        }
+
+        void deliver_hotplug(::libusb_context& context, std::vector<hotplug_notification> const& notifications)
+        {
+            for (auto const& notification : notifications)
+            {
+                auto callbacks = std::vector<hotplug_callback>{};
+                {
+                    auto const lock = std::lock_guard{context.mutex};
+                    callbacks = context.hotplug_callbacks;
+                }
+
+                for (auto const& callback : callbacks)
+                {
+                    if (matches(callback, notification.device, notification.event)
+                        && callback.fn(&context, notification.device, notification.event, callback.user_data) != 0)
+                    {
+                        deregister_hotplug(context, callback.handle);
+                    }
+                }
+
+                ::libusb_unref_device(notification.device);
+            }
+        }
+
+        // CPU time of the threads in handle_events, in nanoseconds
+        auto event_handling_cpu_ns = std::atomic<std::int64_t>{0};
+
+        [[nodiscard]] auto thread_cpu_ns() noexcept -> std::int64_t
+        {
+            auto time = ::timespec{};
+            ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+            return static_cast<std::int64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+        }
+
+        // Adds the CPU time the calling thread spends in its scope to event_handling_cpu_ns
+        class event_handling_cpu_timer
+        {
+          public:
+            event_handling_cpu_timer() noexcept
+              : start_{thread_cpu_ns()} { }
+
+            event_handling_cpu_timer(event_handling_cpu_timer const&) = delete;
+
+            ~event_handling_cpu_timer() noexcept
+            {
+                event_handling_cpu_ns.fetch_add(thread_cpu_ns() - start_, std::memory_order_relaxed);
+            }
+
+            auto operator=(event_handling_cpu_timer const&) = delete;
+
+          private:
+            std::int64_t start_;
+        };
+
+        [[nodiscard]] auto handle_events(::libusb_context& context, clock::duration const timeout, int* const completed) -> int
+        {
+            auto const cpu_timer = event_handling_cpu_timer{};
+            auto const deadline = clock::now() + timeout;
+            auto notifications = std::vector<hotplug_notification>{};
+
+            {
+                auto lock = std::unique_lock{context.mutex};
+
+                if (context.polled)
+                {
+                    auto value = std::uint64_t{};
+                    [[maybe_unused]] auto const events = ::read(context.event_fd, &value, sizeof(value));
+                    [[maybe_unused]] auto const expirations = ::read(context.timer_fd, &value, sizeof(value));
+                }
+
+                while (true)
+                {
+                    drop_stale(context);
+
+                    auto const now = clock::now();
+                    if (std::exchange(context.interrupted, false)
+                        || !context.hotplug_notifications.empty()
+                        || (!context.queue.empty() && context.queue.front().due <= now)
+                        || (completed != nullptr && *completed)
+                        || now >= deadline)
+                    {
+                        break;
+                    }
+
+                    auto const wake_up = context.queue.empty()
+                                             ? deadline
+                                             : std::min(deadline, context.queue.front().due);
+                    context.cv.wait_until(lock, wake_up);
+                }
+
+                auto const now = clock::now();
+                while (!context.queue.empty() && context.queue.front().due <= now)
+                {
+                    auto const entry = context.queue.front();
+                    std::pop_heap(context.queue.begin(), context.queue.end());
+                    context.queue.pop_back();
+
+                    auto& header = header_of(entry.transfer);
+                    if (header.generation != entry.generation || header.state == transfer_state::idle) { continue; }
+
+                    header.state = transfer_state::idle;
+                    context.ready.push_back(entry.transfer);
+                }
+
+                notifications.swap(context.hotplug_notifications);
+
+                drop_stale(context);
+                if (!context.queue.empty())
+                {
+                    arm_timer(context, context.queue.front().due);
+                }
+            }
+
+            deliver_hotplug(context, notifications);
+
+            // Only one thread handles the events of a context, as with libusb
+            for (auto const transfer : context.ready)
+            {
+                auto& state = *transfer->dev_handle->device->state;
+                {
+                    auto const lock = std::lock_guard{state.mutex};
+                    ++state.stats.completed;
+                    if (transfer->status == ::LIBUSB_TRANSFER_CANCELLED) { ++state.stats.cancelled; }
+                }
+
+                transfer->callback(transfer);
+            }
+            context.ready.clear();
+
+            return ::LIBUSB_SUCCESS;
+        }
+    }  // namespace
+
+    auto add_device(simulated_device_config const& config) -> simulated_device_id
+    {
+        auto& bus = the_bus();
+        auto contexts = std::vector<std::pair<::libusb_context*, ::libusb_device*>>{};
+        auto id = simulated_device_id{};
+
+        {
+            auto const lock = std::lock_guard{bus.mutex};
+            id = bus.next_id++;
+
+            auto state = std::make_shared<device_state>(id, config);
+            if (state->config.device_address == 0)
+            {
+                state->config.device_address = bus.next_address++;
+            }
+            bus.devices.push_back(state);
+
+            for (auto const context : bus.contexts)
+            {
+                auto const device = new_device(context, state);
+                context->devices.push_back(device);
+                contexts.emplace_back(context, device);
+            }
+        }
+
+        for (auto const& [context, device] : contexts)
+        {
+            notify_hotplug(*context, device, ::LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+        }
+
+        return id;
+    }
+
+    void remove_device(simulated_device_id const id)
+    {
+        auto& bus = the_bus();
+        auto state = std::shared_ptr<device_state>{};
+        auto removed = std::vector<std::pair<::libusb_context*, ::libusb_device*>>{};
+
+        {
+            auto const lock = std::lock_guard{bus.mutex};
+
+            auto const iter = std::ranges::find(bus.devices, id, &device_state::id);
+            if (iter == bus.devices.end()) { return; }
+            state = *iter;
+            bus.devices.erase(iter);
+
+            for (auto const context : bus.contexts)
+            {
+                auto const device = std::ranges::find(context->devices, state, &::libusb_device::state);
+                removed.emplace_back(context, *device);
+                context->devices.erase(device);
+            }
+        }
+
+        {
+            auto const lock = std::lock_guard{state->mutex};
+            state->removed = true;
+            fail_pending(*state);
+        }
+
+        for (auto const& [context, device] : removed)
+        {
+            {
+                auto const lock = std::lock_guard{context->mutex};
+                for (auto const& entry : context->queue)
+                {
+                    if (entry.transfer->dev_handle->device->state == state
+                        && header_of(entry.transfer).generation == entry.generation)
+                    {
+                        entry.transfer->status = ::LIBUSB_TRANSFER_NO_DEVICE;
+                    }
+                }
+            }
+
+            notify_hotplug(*context, device, ::LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
+            ::libusb_unref_device(device);
+        }
+    }
+
+    auto device_stats(simulated_device_id const id) -> simulated_device_stats
+    {
+        auto& bus = the_bus();
+        auto const lock = std::lock_guard{bus.mutex};
+
+        auto const iter = std::ranges::find(bus.devices, id, &device_state::id);
+        if (iter == bus.devices.end()) { return {}; }
+
+        auto const state_lock = std::lock_guard{(*iter)->mutex};
+        return (*iter)->stats;
+    }
+
+    auto event_handling_cpu_time() -> std::chrono::nanoseconds
+    {
+        return std::chrono::nanoseconds{event_handling_cpu_ns.load(std::memory_order_relaxed)};
+    }
+
+    void reset()
+    {
+        auto ids = std::vector<simulated_device_id>{};
+        {
+            auto& bus = the_bus();
+            auto const lock = std::lock_guard{bus.mutex};
+            for (auto const& state : bus.devices)
+            {
+                ids.push_back(state->id);
+            }
+        }
+
+        for (auto const id : ids)
+        {
+            remove_device(id);
+        }
+    }
+}  // namespace usb_asio::simulation
+
+namespace sim = usb_asio::simulation;
+
+extern "C"
+{
+    int LIBUSB_CALL libusb_init(libusb_context** const context_ptr)
+    {
+        auto& bus = sim::the_bus();
+
+        auto context = std::make_unique<::libusb_context>();
+        context->event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        context->timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (context->event_fd < 0 || context->timer_fd < 0)
+        {
+            ::close(context->event_fd);
+            ::close(context->timer_fd);
+            return ::LIBUSB_ERROR_OTHER;
+        }
+        context->pollfds = {
+            ::libusb_pollfd{context->event_fd, POLLIN},
+            ::libusb_pollfd{context->timer_fd, POLLIN},
+        };
+
+        auto const lock = std::lock_guard{bus.mutex};
+        for (auto const& state : bus.devices)
+        {
+            context->devices.push_back(sim::new_device(context.get(), state));
+        }
+        bus.contexts.push_back(context.get());
+
+        if (context_ptr != nullptr)
+        {
+            *context_ptr = context.release();
+        }
+        else if (bus.default_context == nullptr)
+        {
+            bus.default_context = context.release();
+        }
+
+        return ::LIBUSB_SUCCESS;
+    }
+
+    void LIBUSB_CALL libusb_exit(libusb_context* const context)
+    {
+        auto& bus = sim::the_bus();
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return; }
+
+        {
+            auto const lock = std::lock_guard{bus.mutex};
+            std::erase(bus.contexts, resolved);
+            if (resolved == bus.default_context) { bus.default_context = nullptr; }
+        }
+
+        for (auto const device : resolved->devices)
+        {
+            ::libusb_unref_device(device);
+        }
+        for (auto const& notification : resolved->hotplug_notifications)
+        {
+            ::libusb_unref_device(notification.device);
+        }
+        ::close(resolved->event_fd);
+        ::close(resolved->timer_fd);
+        delete resolved;
+    }
+
+    int LIBUSB_CALL libusb_has_capability(uint32_t const capability)
+    {
+        return capability == ::LIBUSB_CAP_HAS_CAPABILITY || capability == ::LIBUSB_CAP_HAS_HOTPLUG;
+    }
+
+    char const* LIBUSB_CALL libusb_strerror(enum libusb_error const error)
+    {
+        switch (error)
+        {
+            case ::LIBUSB_SUCCESS: return "Success";
+            case ::LIBUSB_ERROR_IO: return "Input/Output Error";
+            case ::LIBUSB_ERROR_INVALID_PARAM: return "Invalid parameter";
+            case ::LIBUSB_ERROR_ACCESS: return "Access denied (insufficient permissions)";
+            case ::LIBUSB_ERROR_NO_DEVICE: return "No such device (it may have been disconnected)";
+            case ::LIBUSB_ERROR_NOT_FOUND: return "Entity not found";
+            case ::LIBUSB_ERROR_BUSY: return "Resource busy";
+            case ::LIBUSB_ERROR_TIMEOUT: return "Operation timed out";
+            case ::LIBUSB_ERROR_OVERFLOW: return "Overflow";
+            case ::LIBUSB_ERROR_PIPE: return "Pipe error";
+            case ::LIBUSB_ERROR_INTERRUPTED: return "System call interrupted (perhaps due to signal)";
+            case ::LIBUSB_ERROR_NO_MEM: return "Insufficient memory";
+            case ::LIBUSB_ERROR_NOT_SUPPORTED: return "Operation not supported or unimplemented on this platform";
+            default: return "Other error";
+        }
+    }
+
+    ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context* const context, libusb_device*** const list)
+    {
+        auto& bus = sim::the_bus();
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return ::LIBUSB_ERROR_INVALID_PARAM; }
+
+        auto const lock = std::lock_guard{bus.mutex};
+        auto const num_devices = resolved->devices.size();
+        auto const devices = static_cast<libusb_device**>(std::calloc(num_devices + 1u, sizeof(libusb_device*)));
+        if (devices == nullptr) { return ::LIBUSB_ERROR_NO_MEM; }
+
+        for (auto index = std::size_t{0}; index < num_devices; ++index)
+        {
+            devices[index] = ::libusb_ref_device(resolved->devices[index]);
+        }
+        *list = devices;
+
+        return static_cast<ssize_t>(num_devices);
+    }
+
+    void LIBUSB_CALL libusb_free_device_list(libusb_device** const list, int const unref_devices)
+    {
+        if (list == nullptr) { return; }
+
+        if (unref_devices)
+        {
+            for (auto device = list; *device != nullptr; ++device)
+            {
+                ::libusb_unref_device(*device);
+            }
+        }
+        std::free(list);
+    }
+
+    libusb_device* LIBUSB_CALL libusb_ref_device(libusb_device* const device)
+    {
+        device->refs.fetch_add(1, std::memory_order_relaxed);
+        return device;
+    }
+
+    void LIBUSB_CALL libusb_unref_device(libusb_device* const device)
+    {
+        if (device != nullptr && device->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete device;
+        }
+    }
+
+    uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device* const device)
+    {
+        return device->state->config.bus_number;
+    }
+
+    uint8_t LIBUSB_CALL libusb_get_port_number(libusb_device* const device)
+    {
+        return device->state->config.device_address;
+    }
+
+    int LIBUSB_CALL libusb_get_port_numbers(libusb_device* const device, uint8_t* const port_numbers, int const port_numbers_len)
+    {
+        if (port_numbers_len < 1) { return ::LIBUSB_ERROR_OVERFLOW; }
+
+        port_numbers[0] = ::libusb_get_port_number(device);
+        return 1;
+    }
+
+    libusb_device* LIBUSB_CALL libusb_get_parent(libusb_device*)
+    {
+        return nullptr;
+    }
+
+    uint8_t LIBUSB_CALL libusb_get_device_address(libusb_device* const device)
+    {
+        return device->state->config.device_address;
+    }
+
+    int LIBUSB_CALL libusb_get_device_speed(libusb_device* const device)
+    {
+        return static_cast<int>(device->state->config.speed);
+    }
+
+    int LIBUSB_CALL libusb_get_max_packet_size(libusb_device* const device, unsigned char const endpoint)
+    {
+        return sim::max_packet_size(device, endpoint);
+    }
+
+    int LIBUSB_CALL libusb_get_max_iso_packet_size(libusb_device* const device, unsigned char const endpoint)
+    {
+        auto const size = sim::max_packet_size(device, endpoint);
+        if (size < 0) { return size; }
+
+        // Additional transactions per microframe, as with high speed
+        return (size & 0x7FF) * (1 + ((size >> 11) & 0x3));
+    }
+
+    int LIBUSB_CALL libusb_get_device_descriptor(libusb_device* const device, struct libusb_device_descriptor* const descriptor)
+    {
+        auto const& config = device->state->config;
+        *descriptor = {};
+        descriptor->bLength = LIBUSB_DT_DEVICE_SIZE;
+        descriptor->bDescriptorType = ::LIBUSB_DT_DEVICE;
+        descriptor->bcdUSB = 0x0200u;
+        descriptor->bDeviceClass = ::LIBUSB_CLASS_PER_INTERFACE;
+        descriptor->bMaxPacketSize0 = 64;
+        descriptor->idVendor = config.vendor_id;
+        descriptor->idProduct = config.product_id;
+        descriptor->bNumConfigurations = 1;
+        return ::LIBUSB_SUCCESS;
+    }
+
+    int LIBUSB_CALL libusb_get_active_config_descriptor(libusb_device* const device, struct libusb_config_descriptor** const config)
+    {
+        *config = sim::make_config_descriptor(*device->state);
+        return *config != nullptr ? ::LIBUSB_SUCCESS : ::LIBUSB_ERROR_NO_MEM;
+    }
+
+    int LIBUSB_CALL libusb_get_config_descriptor(libusb_device* const device, uint8_t const config_index, struct libusb_config_descriptor** const config)
+    {
+        if (config_index != 0) { return ::LIBUSB_ERROR_NOT_FOUND; }
+
+        return ::libusb_get_active_config_descriptor(device, config);
+    }
+
+    int LIBUSB_CALL libusb_get_config_descriptor_by_value(libusb_device* const device, uint8_t const config_value, struct libusb_config_descriptor** const config)
+    {
+        if (config_value != 1) { return ::LIBUSB_ERROR_NOT_FOUND; }
+
+        return ::libusb_get_active_config_descriptor(device, config);
+    }
+
+    void LIBUSB_CALL libusb_free_config_descriptor(struct libusb_config_descriptor* const config)
+    {
+        // The first member of the block
+        std::free(config);
+    }
+
+    int LIBUSB_CALL libusb_open(libusb_device* const device, libusb_device_handle** const handle)
+    {
+        {
+            auto const lock = std::lock_guard{device->state->mutex};
+            if (device->state->removed) { return ::LIBUSB_ERROR_NO_DEVICE; }
+        }
+
+        *handle = new (std::nothrow) libusb_device_handle{::libusb_ref_device(device)};
+        if (*handle == nullptr)
+        {
+            ::libusb_unref_device(device);
+            return ::LIBUSB_ERROR_NO_MEM;
+        }
+
+        return ::LIBUSB_SUCCESS;
+    }
+
+    void LIBUSB_CALL libusb_close(libusb_device_handle* const handle)
+    {
+        if (handle == nullptr) { return; }
+
+        ::libusb_unref_device(handle->device);
+        delete handle;
+    }
+
+    libusb_device* LIBUSB_CALL libusb_get_device(libusb_device_handle* const handle)
+    {
+        return handle->device;
+    }
+
+    int LIBUSB_CALL libusb_set_configuration(libusb_device_handle* const handle, int const configuration)
+    {
+        usb_asio::simulation::simulate_blocking_request(*handle);
+        return configuration == 1 || configuration == -1 ? ::LIBUSB_SUCCESS : ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_claim_interface(libusb_device_handle*, int const interface_number)
+    {
+        return interface_number == 0 ? ::LIBUSB_SUCCESS : ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_release_interface(libusb_device_handle* const handle, int const interface_number)
+    {
+        usb_asio::simulation::simulate_blocking_request(*handle);
+        return interface_number == 0 ? ::LIBUSB_SUCCESS : ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_set_interface_alt_setting(libusb_device_handle* const handle, int const interface_number, int const alt_setting)
+    {
+        usb_asio::simulation::simulate_blocking_request(*handle);
+        return interface_number == 0 && alt_setting == 0 ? ::LIBUSB_SUCCESS : ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_clear_halt(libusb_device_handle* const handle, unsigned char)
+    {
+        usb_asio::simulation::simulate_blocking_request(*handle);
+        return ::LIBUSB_SUCCESS;
+    }
+
+    int LIBUSB_CALL libusb_reset_device(libusb_device_handle* const handle)
+    {
+        usb_asio::simulation::simulate_blocking_request(*handle);
+        return ::LIBUSB_SUCCESS;
+    }
+
+    int LIBUSB_CALL libusb_kernel_driver_active(libusb_device_handle*, int)
+    {
+        return 0;
+    }
+
+    int LIBUSB_CALL libusb_detach_kernel_driver(libusb_device_handle*, int)
+    {
+        return ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_attach_kernel_driver(libusb_device_handle*, int)
+    {
+        return ::LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    int LIBUSB_CALL libusb_alloc_streams(libusb_device_handle*, uint32_t const num_streams, unsigned char*, int)
+    {
+        return static_cast<int>(num_streams);
+    }
+
+    int LIBUSB_CALL libusb_free_streams(libusb_device_handle*, unsigned char*, int)
+    {
+        return ::LIBUSB_SUCCESS;
+    }
+
+    unsigned char* LIBUSB_CALL libusb_dev_mem_alloc(libusb_device_handle* const handle, size_t const length)
+    {
+        if (!handle->device->state->config.dma_memory) { return nullptr; }
+
+        return static_cast<unsigned char*>(std::aligned_alloc(
+            sim::page_size,
+            (length + sim::page_size - 1u) / sim::page_size * sim::page_size));
+    }
+
+    int LIBUSB_CALL libusb_dev_mem_free(libusb_device_handle*, unsigned char* const buffer, size_t)
+    {
+        std::free(buffer);
+        return ::LIBUSB_SUCCESS;
+    }
+
+    struct libusb_transfer* LIBUSB_CALL libusb_alloc_transfer(int const iso_packets)
+    {
+        auto const size = sim::transfer_header_size
+                          + sizeof(::libusb_transfer)
+                          + static_cast<std::size_t>(iso_packets) * sizeof(::libusb_iso_packet_descriptor);
+
+        auto const block = static_cast<std::byte*>(std::calloc(1, size));
+        if (block == nullptr) { return nullptr; }
+
+        ::new (block) sim::transfer_header{};
+        auto const transfer = reinterpret_cast<::libusb_transfer*>(block + sim::transfer_header_size);
+        transfer->num_iso_packets = iso_packets;
+        return transfer;
+    }
+
+    void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer* const transfer)
+    {
+        if (transfer == nullptr) { return; }
+
+        std::free(reinterpret_cast<std::byte*>(transfer) - sim::transfer_header_size);
+    }
+
+    void LIBUSB_CALL libusb_transfer_set_stream_id(struct libusb_transfer* const transfer, uint32_t const stream_id)
+    {
+        sim::header_of(transfer).stream_id = stream_id;
+    }
+
+    uint32_t LIBUSB_CALL libusb_transfer_get_stream_id(struct libusb_transfer* const transfer)
+    {
+        return sim::header_of(transfer).stream_id;
+    }
+
+    int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer* const transfer)
+    {
+        auto& header = sim::header_of(transfer);
+        auto& state = *transfer->dev_handle->device->state;
+        auto& context = *transfer->dev_handle->device->context;
+
+        auto const lock = std::lock_guard{state.mutex};
+        if (header.state != sim::transfer_state::idle) { return ::LIBUSB_ERROR_BUSY; }
+        if (state.removed) { return ::LIBUSB_ERROR_NO_DEVICE; }
+        if (transfer->type != ::LIBUSB_TRANSFER_TYPE_CONTROL && state.find_endpoint(transfer->endpoint) == nullptr)
+        {
+            return ::LIBUSB_ERROR_NOT_FOUND;
+        }
+
+        ++state.stats.submitted;
+        transfer->status = ::LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = 0;
+
+        if (state.config.error_rate > 0.0
+            && std::uniform_real_distribution<double>{}(state.rng) < state.config.error_rate)
+        {
+            ++state.stats.failed;
+            transfer->status = state.config.error_status;
+        }
+        else if (!sim::simulate_data(state, *transfer))
+        {
+            // Waiting for looped back data
+            if (transfer->timeout != 0)
+            {
+                auto const context_lock = std::lock_guard{context.mutex};
+                transfer->status = ::LIBUSB_TRANSFER_TIMED_OUT;
+                sim::enqueue(context, transfer, sim::clock::now() + std::chrono::milliseconds{transfer->timeout});
+                header.state = sim::transfer_state::waiting;
+            }
+            return ::LIBUSB_SUCCESS;
+        }
+
+        auto const due = sim::schedule(state, static_cast<std::size_t>(transfer->actual_length));
+        {
+            auto const context_lock = std::lock_guard{context.mutex};
+            sim::enqueue(context, transfer, due);
+        }
+
+        if ((transfer->endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT && state.config.loopback)
+        {
+            sim::serve_waiting(state, transfer->endpoint & LIBUSB_ENDPOINT_ADDRESS_MASK);
+        }
+
+        return ::LIBUSB_SUCCESS;
+    }
+
+    int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer* const transfer)
+    {
+        auto& header = sim::header_of(transfer);
+        auto& state = *transfer->dev_handle->device->state;
+        auto& context = *transfer->dev_handle->device->context;
+
+        auto const lock = std::lock_guard{state.mutex};
+        // The event thread completes queued transfers with only the context lock
+        auto const context_lock = std::lock_guard{context.mutex};
+        if (header.state == sim::transfer_state::idle) { return ::LIBUSB_ERROR_NOT_FOUND; }
+
+        if (header.state == sim::transfer_state::waiting)
+        {
+            std::erase(state.waiting_transfers[transfer->endpoint & LIBUSB_ENDPOINT_ADDRESS_MASK], transfer);
+        }
+
+        transfer->status = ::LIBUSB_TRANSFER_CANCELLED;
+        sim::enqueue(context, transfer, sim::clock::now());
+
+        return ::LIBUSB_SUCCESS;
+    }
+
+    int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context* const context, struct timeval* const tv, int* const completed)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return ::LIBUSB_ERROR_INVALID_PARAM; }
+
+        auto const timeout = std::chrono::seconds{tv->tv_sec} + std::chrono::microseconds{tv->tv_usec};
+        return sim::handle_events(*resolved, timeout, completed);
+    }
+
+    int LIBUSB_CALL libusb_handle_events_timeout(libusb_context* const context, struct timeval* const tv)
+    {
+        return ::libusb_handle_events_timeout_completed(context, tv, nullptr);
+    }
+
+    int LIBUSB_CALL libusb_handle_events_completed(libusb_context* const context, int* const completed)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return ::LIBUSB_ERROR_INVALID_PARAM; }
+
+        return sim::handle_events(*resolved, sim::default_event_timeout, completed);
+    }
+
+    int LIBUSB_CALL libusb_handle_events(libusb_context* const context)
+    {
+        return ::libusb_handle_events_completed(context, nullptr);
+    }
+
+    void LIBUSB_CALL libusb_interrupt_event_handler(libusb_context* const context)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return; }
+
+        auto const lock = std::lock_guard{resolved->mutex};
+        resolved->interrupted = true;
+        sim::signal(*resolved);
+    }
+
+    int LIBUSB_CALL libusb_pollfds_handle_timeouts(libusb_context*)
+    {
+        // Transfer completions and timeouts are both signalled on the fds
+        return 1;
+    }
+
+    int LIBUSB_CALL libusb_get_next_timeout(libusb_context* const context, struct timeval* const tv)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return ::LIBUSB_ERROR_INVALID_PARAM; }
+
+        auto const lock = std::lock_guard{resolved->mutex};
+        sim::drop_stale(*resolved);
+        if (resolved->queue.empty()) { return 0; }
+
+        auto const remaining = std::max(
+            std::chrono::duration_cast<std::chrono::microseconds>(resolved->queue.front().due - sim::clock::now()),
+            std::chrono::microseconds{0});
+        tv->tv_sec = static_cast<decltype(tv->tv_sec)>(remaining.count() / 1'000'000);
+        tv->tv_usec = static_cast<decltype(tv->tv_usec)>(remaining.count() % 1'000'000);
+        return 1;
+    }
+
+    const struct libusb_pollfd** LIBUSB_CALL libusb_get_pollfds(libusb_context* const context)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr) { return nullptr; }
+
+        auto const pollfds = static_cast<libusb_pollfd const**>(std::calloc(3, sizeof(libusb_pollfd const*)));
+        if (pollfds == nullptr) { return nullptr; }
+
+        auto const lock = std::lock_guard{resolved->mutex};
+        resolved->polled = true;
+        // Anything already pending is handled on the first poll
+        sim::arm_timer(*resolved, {});
+        pollfds[0] = &resolved->pollfds[0];
+        pollfds[1] = &resolved->pollfds[1];
+        return pollfds;
+    }
+
+    void LIBUSB_CALL libusb_free_pollfds(const struct libusb_pollfd** const pollfds)
+    {
+        std::free(pollfds);
+    }
+
+    void LIBUSB_CALL libusb_set_pollfd_notifiers(
+        libusb_context* const context,
+        libusb_pollfd_added_cb,
+        libusb_pollfd_removed_cb,
+        void*)
+    {
+        // The fds never change, nothing to notify
+        if (auto const resolved = sim::resolve(context))
+        {
+            auto const lock = std::lock_guard{resolved->mutex};
+            resolved->polled = true;
+            sim::arm_timer(*resolved, {});
+        }
+    }
+
+    int LIBUSB_CALL libusb_hotplug_register_callback(
+        libusb_context* const context,
+        libusb_hotplug_event const events,
+        libusb_hotplug_flag const flags,
+        int const vendor_id,
+        int const product_id,
+        int const device_class,
+        libusb_hotplug_callback_fn const callback_fn,
+        void* const user_data,
+        libusb_hotplug_callback_handle* const callback_handle)
+    {
+        auto const resolved = sim::resolve(context);
+        if (resolved == nullptr || callback_fn == nullptr) { return ::LIBUSB_ERROR_INVALID_PARAM; }
+
+        auto callback = sim::hotplug_callback{
+            .handle = 0,
+            .events = events,
+            .vendor_id = vendor_id,
+            .product_id = product_id,
+            .device_class = device_class,
+            .fn = callback_fn,
+            .user_data = user_data,
+        };
+        {
+            auto const lock = std::lock_guard{resolved->mutex};
+            callback.handle = resolved->next_hotplug_handle++;
+            resolved->hotplug_callbacks.push_back(callback);
+        }
+        if (callback_handle != nullptr)
+        {
+            *callback_handle = callback.handle;
+        }
+
+        if (flags & ::LIBUSB_HOTPLUG_ENUMERATE)
+        {
+            auto devices = static_cast<libusb_device**>(nullptr);
+            auto const num_devices = ::libusb_get_device_list(resolved, &devices);
+            for (auto index = ssize_t{0}; index < num_devices; ++index)
+            {
+                if (sim::matches(callback, devices[index], ::LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED))
+                {
+                    callback_fn(resolved, devices[index], ::LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data);
+                }
+            }
+            ::libusb_free_device_list(devices, true);
+        }
+
+        return ::LIBUSB_SUCCESS;
+    }
+
+    void LIBUSB_CALL libusb_hotplug_deregister_callback(libusb_context* const context, libusb_hotplug_callback_handle const callback_handle)
+    {
+        if (auto const resolved = sim::resolve(context))
+        {
+            sim::deregister_hotplug(*resolved, callback_handle);
+        }
+    }
+}